@@ -1,7 +1,13 @@
 #include "AI.h"
 
+#include "BitBoard.h"
+#include "EvaluationCache.h"
+#include "ThreadPool.h"
+
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <map>
@@ -13,123 +19,115 @@ namespace Reversi
 {
     void AI::Learn(const Logic& game_over_state) {}
 
-    DecisionTreeAI::DecisionTreeAI(int depth) : Depth(depth)
+    void AI::QueueLearning(const Logic& game_over_state)
+    {
+        Learn(game_over_state);
+    }
+
+    void AI::WaitForLearning() {}
+
+    void AI::ObserveMove(const Logic& state) {}
+
+    void AI::Ponder(const Logic& state) {}
+
+    void AI::StopPondering() {}
+
+    void AI::SetSeed(unsigned int seed) {}
+
+    DecisionTreeAI::DecisionTreeAI(int depth, std::shared_ptr<EvolvingAI> move_ordering_ai, std::shared_ptr<const PatternWeights> weights,
+        std::shared_ptr<const NetworkWeights> network)
+        : MoveOrderingAI(move_ordering_ai),
+          Searcher(CreateEngine(depth, move_ordering_ai.get(), weights, network))
     {
     }
 
-    constexpr static float MIN_SCORE = -100;
-    constexpr static float MAX_SCORE = 100;
+    DecisionTreeAI::Engine DecisionTreeAI::CreateEngine(int depth, EvolvingAI* move_ordering_ai,
+        std::shared_ptr<const PatternWeights> weights, std::shared_ptr<const NetworkWeights> network)
+    {
+        EvolvingAIMoveOrderer move_orderer { move_ordering_ai };
+        if (network != nullptr)
+            return Engine(std::in_place_index<0>, depth, NetworkEvaluator { network }, move_orderer);
+        if (weights != nullptr)
+            return Engine(std::in_place_index<1>, depth, PatternEvaluator { weights }, move_orderer);
+        return Engine(std::in_place_index<2>, depth, DiscRatioEvaluator(), move_orderer);
+    }
 
     std::optional<std::tuple<int, int>> DecisionTreeAI::Decide(const Logic& state)
     {
-        std::optional<std::tuple<int, int>> result;
-        if (state.GetCurrentTurn() == Side::None || state.IsGameOver())
-            return result;
-        int best_x = -1;
-        int best_y = -1;
-        float best_score = MIN_SCORE;
-        for (int x = 0; x < 8; x++)
-        {
-            for (int y = 0; y < 8; y++)
-            {
-                if (state.CanMakeMove(x, y))
-                {
-                    auto new_state = state;
-                    new_state.MakeMove(x, y);
-                    float score = CalculateScore(new_state, state.GetCurrentTurn(), Depth, best_score, MAX_SCORE);
-                    if (score > best_score)
-                    {
-                        best_x = x;
-                        best_y = y;
-                        best_score = score;
-                    }
-                }
-            }
-        }
-        if (best_x != -1)
-        {
-            result = std::make_tuple(best_x, best_y);
-        }
-        return result;
+        return std::visit([&](auto& engine) { return engine.Decide(state); }, Searcher);
+    }
+
+    void DecisionTreeAI::Ponder(const Logic& state)
+    {
+        std::visit([&](auto& engine) { return engine.Ponder(state); }, Searcher);
+    }
+
+    void DecisionTreeAI::StopPondering()
+    {
+        std::visit([&](auto& engine) { return engine.StopPondering(); }, Searcher);
+    }
+
+    std::vector<DecisionTreeAI::MoveAnalysis> DecisionTreeAI::Analyze(const Logic& state, int count)
+    {
+        return std::visit([&](auto& engine) { return engine.Analyze(state, count); }, Searcher);
+    }
+
+    DecisionTreeAI::SearchStatistics DecisionTreeAI::GetLastSearchStatistics()
+    {
+        return std::visit([&](auto& engine) { return engine.GetLastSearchStatistics(); }, Searcher);
+    }
+
+    void DecisionTreeAI::SetLogStatistics(bool value)
+    {
+        std::visit([&](auto& engine) { return engine.SetLogStatistics(value); }, Searcher);
     }
 
     int DecisionTreeAI::GetDepth()
     {
-        return Depth;
+        return std::visit([&](auto& engine) { return engine.GetDepth(); }, Searcher);
     }
 
     void DecisionTreeAI::SetDepth(int value)
     {
-        Depth = value;
+        std::visit([&](auto& engine) { return engine.SetDepth(value); }, Searcher);
     }
 
-    float DecisionTreeAI::CalculateScore(const Logic& state, Side side, int depth, float alpha, float beta)
+    long long DecisionTreeAI::GetNodeBudget()
     {
-        bool should_maximize_score = state.GetCurrentTurn() == side;
-        int count = 0;
-        float score = should_maximize_score ? MIN_SCORE : MAX_SCORE;
-        if (depth <= 0)
-            return CalculateScoreTerminal(state, side);
-        for (int x = 0; x < 8; x++)
-        {
-            for (int y = 0; y < 8; y++)
-            {
-                if (state.CanMakeMove(x, y))
-                {
-                    auto new_state = state;
-                    new_state.MakeMove(x, y);
-                    int local_score = CalculateScore(new_state, side, depth - 1, alpha, beta);
-                    if (should_maximize_score && local_score > score)
-                    {
-                        score = local_score;
-                        if (score >= beta)
-                            return score;
-                        if (score > alpha)
-                            alpha = score;
-                    }
-                    else if (!should_maximize_score && local_score < score)
-                    {
-                        score = local_score;
-                        if (score <= alpha)
-                            return score;
-                        if (score < beta)
-                            beta = score;
-                    }
-                    count += 1;
-                }
-            }
-        }
-        if (count == 0)
-            return CalculateScoreTerminal(state, side);
-        return score;
+        return std::visit([&](auto& engine) { return engine.GetNodeBudget(); }, Searcher);
     }
 
-    float DecisionTreeAI::CalculateScoreTerminal(const Logic& state, Side side)
+    void DecisionTreeAI::SetNodeBudget(long long value)
     {
-        int win_points = 0;
-        int lose_points = 0;
-        for (int x = 0; x < 8; x++)
-        {
-            for (int y = 0; y < 8; y++)
-            {
-                Side disk_side = state.Get(x, y);
-                if (disk_side == side)
-                {
-                    win_points++;
-                }
-                else if (disk_side != Side::None)
-                {
-                    lose_points++;
-                }
-            }
-        }
-        return (float)win_points / (float)(win_points + lose_points);
+        std::visit([&](auto& engine) { return engine.SetNodeBudget(value); }, Searcher);
     }
 
     constexpr float EVOLVING_AI_MIN_SCORE = -100;
 
-    EvolvingAI::EvolvingAI(std::string DataFilePath, float LearningRate, float Generalization)
-        : DataFilePath(DataFilePath), LearningRate(LearningRate), Generalization(Generalization)
+    /// @brief Move scores keyed by state hash, move and EvolvingAI::ScoreCacheSalt. 2^15 entries of 8 bytes, 256 KiB.
+    thread_local EvaluationCache<float, 15> evolving_ai_score_cache;
+    std::atomic<unsigned long long> evolving_ai_score_cache_generation(0);
+
+    /// @brief Reads a cell of EvolvingAI::Data, which the learners may be changing.
+    inline unsigned short evolving_ai_load_cell(unsigned short& cell)
+    {
+        return std::atomic_ref<unsigned short>(cell).load(std::memory_order_relaxed);
+    }
+
+    /// @brief Writes a cell of EvolvingAI::Data, which the other processes may be changing with Storage::Shared.
+    inline void evolving_ai_store_cell(unsigned short& cell, unsigned short value)
+    {
+        std::atomic_ref<unsigned short>(cell).store(value, std::memory_order_relaxed);
+    }
+
+    EvolvingAI::EvolvingAI(std::string DataFilePath, float LearningRate, float Generalization, Storage DataStorage, int FlushInterval,
+        bool DecayByVisits)
+        : LearningRate(LearningRate), Generalization(Generalization), DataFilePath(DataFilePath),
+          DataStorage(DataStorage), FlushInterval(FlushInterval), DecayByVisits(DecayByVisits), UnflushedGamesCount(0),
+          JournalFilePath(DataFilePath + ".journal"), SharedFilePath(DataFilePath + ".shared"), JournalSize(0), IsCompacting(false),
+          ObservationsCount(0), IsLearningQueue(false), Random(std::random_device()()), DataBuffer(new unsigned short[DATA_SIZE * 2]), SharedGeneration(nullptr),
+          Data(DataBuffer.get()), Visits(DataBuffer.get() + DATA_SIZE),
+          CompactionTask(TaskPriority::Background), LearningTask(TaskPriority::Background)
     {
         if (LearningRate < 0)
             LearningRate = 0;
@@ -140,17 +138,21 @@ namespace Reversi
         if (Generalization > 1)
             Generalization = 1;
         Load();
+        InvalidateScoreCache();
     }
 
     std::optional<std::tuple<int, int>> EvolvingAI::Decide(const Logic& state)
     {
         if (state.GetCurrentTurn() == Side::None || state.IsGameOver())
             return std::optional<std::tuple<int, int>>();
+        std::shared_lock<std::shared_mutex> lock(DataMutex);
         std::vector<std::tuple<int, int>> best_moves;
         float best_score = EVOLVING_AI_MIN_SCORE;
 #if REVERSI_DEBUG
         std::map<std::tuple<int, int>, float> location_to_score;
 #endif
+        BitBoard board = BitBoard::FromLogic(state, state.GetCurrentTurn());
+        unsigned long long moves = board.GetMoves();
         for (int x = 0; x < 8; x++)
         {
             for (int y = 0; y < 8; y++)
@@ -158,11 +160,10 @@ namespace Reversi
 #if REVERSI_DEBUG
                 location_to_score[std::make_tuple(x, y)] = 0;
 #endif
-                if (state.CanMakeMove(x, y))
+                int slot = y << 3 | x;
+                if ((moves >> slot) & 1)
                 {
-                    float score = 0;
-                    for (auto features : GetFeatures(state, x, y))
-                        score += GetScore(features);
+                    float score = GetMoveScore(board, state.GetHash(), slot);
                     if (score > best_score)
                     {
                         best_score = score;
@@ -194,10 +195,12 @@ namespace Reversi
             return std::optional<std::tuple<int, int>>();
         if (best_moves.size() == 1)
             return best_moves[0];
-        std::random_device device;
-        std::mt19937 mt(device());
         std::uniform_int_distribution<std::mt19937::result_type> dist(0, best_moves.size() - 1);
-        int choice = dist(mt);
+        int choice;
+        {
+            std::lock_guard<std::mutex> lock(RandomMutex);
+            choice = dist(Random);
+        }
 #if REVERSI_DEBUG
         Log("AI: Multiple best choices:", " ");
         for (auto item : best_moves)
@@ -219,10 +222,326 @@ namespace Reversi
 
     constexpr int sign(int n) { return n == 0 ? 0 : (n < 0 ? -1 : 1); }
 
+    float EvolvingAI::GetMoveScore(const Logic& state, int x, int y)
+    {
+        std::shared_lock<std::shared_mutex> lock(DataMutex);
+        return GetMoveScore(BitBoard::FromLogic(state, state.GetCurrentTurn()), state.GetHash(), y << 3 | x);
+    }
+
+    void EvolvingAI::GetMoveScores(const Logic& state, const std::tuple<int, int>* moves, int count, float* scores)
+    {
+        BitBoard board = BitBoard::FromLogic(state, state.GetCurrentTurn());
+        auto state_hash = state.GetHash();
+        std::shared_lock<std::shared_mutex> lock(DataMutex);
+        for (int i = 0; i < count; i++)
+            scores[i] = GetMoveScore(board, state_hash, std::get<1>(moves[i]) << 3 | std::get<0>(moves[i]));
+    }
+
+    float EvolvingAI::GetMoveScore(const BitBoard& board, unsigned long long state_hash, int slot)
+    {
+        float score;
+        auto cache_hash = (state_hash ^ GetScoreCacheSalt()) + (unsigned long long)slot * 0x9E3779B97F4A7C15ULL;
+        if (!evolving_ai_score_cache.Get(cache_hash, score))
+        {
+            score = CalculateMoveScore(board, slot);
+            evolving_ai_score_cache.Set(cache_hash, score);
+        }
+        return score;
+    }
+
+    float EvolvingAI::CalculateMoveScore(const BitBoard& board, int slot)
+    {
+        Features features[8];
+        GetFeatures(board, slot, features);
+        float score = 0;
+        for (const auto& direction_features : features)
+            score += GetScore(direction_features);
+        return score;
+    }
+
+    void EvolvingAI::SetSeed(unsigned int seed)
+    {
+        std::lock_guard<std::mutex> lock(RandomMutex);
+        Random.seed(seed);
+    }
+
+    EvolvingAI::GameRecord::GameRecord() : MovesCount(0)
+    {
+        std::fill(Impacts, Impacts + sizeof(Impacts) / sizeof(Impacts[0]), 0.0f);
+    }
+
+    void EvolvingAI::GameRecord::Reset()
+    {
+        // The impacts are only set for the recorded moves, which are the first ones of each slot
+        for (int slot = 0; slot < 64; slot++)
+            std::fill(&ImpactAt(slot, 0, 0), &ImpactAt(slot, 0, 0) + MovesCount * 8, 0.0f);
+        State = Logic();
+        MovesCount = 0;
+    }
+
+    bool EvolvingAI::GameRecord::IsOf(const Logic& state) const
+    {
+        const auto& history = state.GetHistory();
+        if ((int)history.size() != MovesCount)
+            return false;
+        int move_index = 0;
+        for (const auto& move : history)
+        {
+            if ((move.Changes[0].Y << 3 | move.Changes[0].X) != MoveSlots[move_index++])
+                return false;
+        }
+        return true;
+    }
+
+    void EvolvingAI::GameRecord::Update(const Logic& state)
+    {
+        const auto& history = state.GetHistory();
+        if ((int)history.size() == MovesCount + 1)
+        {
+            // Only the last move is new if the others are the recorded ones
+            bool is_next_move = true;
+            int move_index = 0;
+            for (auto move = history.begin(); move_index < MovesCount; move++)
+            {
+                if ((move->Changes[0].Y << 3 | move->Changes[0].X) != MoveSlots[move_index++])
+                {
+                    is_next_move = false;
+                    break;
+                }
+            }
+            if (is_next_move)
+            {
+                AddMove(history.back());
+                return;
+            }
+        }
+        if (IsOf(state))
+            return;
+        Reset();
+        for (const auto& move : history)
+            AddMove(move);
+    }
+
+    float& EvolvingAI::GameRecord::ImpactAt(int slot, int move_index, int direction)
+    {
+        return Impacts[(slot * MAX_MOVES_COUNT + move_index) * 8 + direction];
+    }
+
+    void EvolvingAI::GameRecord::AddImpact(int move_index, int direction, int slot, float factor)
+    {
+        float& impact = ImpactAt(slot, move_index, direction);
+        if (impact > factor) // The existing impact has a higher impact score
+            return;
+        impact = factor;
+        if (slot == MoveSlots[move_index])
+            SharedImpactDirections[move_index] &= ~(1 << direction);
+    }
+
+    void EvolvingAI::GameRecord::AddMove(const Logic::Move& move)
+    {
+        auto move_action = move.Changes[0];
+        auto turn = State.GetCurrentTurn();
+        if (turn == Side::None || turn != move_action.NewState || MovesCount == MAX_MOVES_COUNT)
+            throw std::logic_error("Wrong game history.");
+        int move_index = MovesCount;
+        int move_slot = move_action.Y << 3 | move_action.X;
+        MoveSlots[move_index] = move_slot;
+        MoveSides[move_index] = turn;
+        GetFeatures(BitBoard::FromLogic(State, turn), move_slot, MoveFeatures + move_index * 8);
+        for (const auto& change : move.Changes)
+        {
+            // Update indirect impacts (root: the flipped disks)
+            if (change.OldState == Side::None)
+                continue;
+            int slot = change.Y << 3 | change.X;
+            for (int i = 0; i < move_index; i++)
+            {
+                for (int direction = 0; direction < 8; direction++)
+                {
+                    float& existing_impact = ImpactAt(slot, i, direction);
+                    if (existing_impact == 0)
+                        continue;
+                    float new_impact = existing_impact * EVOLVING_AI_LEARNING_IMPACT_REDUCTION_COEFFICIENT;
+                    // Update impact (where a disk is flipped)
+                    if (slot == MoveSlots[i] && (SharedImpactDirections[i] >> direction & 1))
+                    {
+                        for (int shared_direction = 0; shared_direction < 8; shared_direction++)
+                            if (SharedImpactDirections[i] >> shared_direction & 1)
+                                ImpactAt(slot, i, shared_direction) = new_impact;
+                    }
+                    else
+                    {
+                        existing_impact = new_impact;
+                    }
+                    // Add impact (where the disk is placed: move_action)
+                    AddImpact(i, direction, move_slot, new_impact);
+                }
+            }
+        }
+        for (const auto& end : move.Ends)
+        {
+            // Add indirect impacts (root: the unchanged end disks that caused flips)
+            int end_slot = end.Y << 3 | end.X;
+            for (int i = 0; i < move_index; i++)
+            {
+                for (int direction = 0; direction < 8; direction++)
+                {
+                    float existing_impact = ImpactAt(end_slot, i, direction);
+                    if (existing_impact == 0)
+                        continue;
+                    float new_impact = existing_impact * EVOLVING_AI_LEARNING_IMPACT_REDUCTION_COEFFICIENT;
+                    for (const auto& change : move.Changes)
+                    {
+                        if (change.OldState == Side::None || (
+                                sign(change.X - move_action.X) == sign(end.X - move_action.X)
+                                &&
+                                sign(change.Y - move_action.Y) == sign(end.Y - move_action.Y)
+                            ))
+                            AddImpact(i, direction, change.Y << 3 | change.X, new_impact);
+                    }
+                }
+            }
+        }
+        for (const auto& change : move.Changes)
+        {
+            // Add direct impacts (caused by the new move)
+            int slot = change.Y << 3 | change.X;
+            if (slot == move_slot)
+            {
+                for (int direction = 0; direction < 8; direction++)
+                    ImpactAt(slot, move_index, direction) = 1;
+                SharedImpactDirections[move_index] = 0xFF;
+            }
+            else
+            {
+                int direction = GetGeneralizedDirection(
+                    move_action.X, move_action.Y,
+                    change.X - move_action.X,
+                    change.Y - move_action.Y
+                );
+                ImpactAt(slot, move_index, direction) = 1;
+            }
+        }
+        State.MakeMove(move_action.X, move_action.Y);
+        MovesCount++;
+
+    }
+
     void EvolvingAI::Learn(const Logic& game_over_state)
     {
         if (!game_over_state.IsGameOver() || LearningRate == 0)
             return;
+        LearnGame(game_over_state, TakeGameRecord(game_over_state));
+    }
+
+    void EvolvingAI::ObserveMove(const Logic& state)
+    {
+        if (LearningRate == 0)
+            return;
+        GameRecord* record = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(CurrentGamesMutex);
+            ObservationsCount++;
+            auto current_game = CurrentGames.find(std::this_thread::get_id());
+            if (current_game != CurrentGames.end())
+            {
+                current_game->second.LastObservation = ObservationsCount;
+                current_game->second.IsUpdating = true;
+                record = current_game->second.Record.get();
+            }
+            else
+            {
+                // A new game, the threads that are done may have left their games
+                PruneCurrentGames();
+            }
+        }
+        if (record == nullptr)
+        {
+            auto new_record = AcquireGameRecord();
+            record = new_record.get();
+            std::lock_guard<std::mutex> lock(CurrentGamesMutex);
+            CurrentGames[std::this_thread::get_id()] = CurrentGame { std::move(new_record), ObservationsCount, true };
+        }
+        // Only this thread uses its record, until the game is learned
+        std::exception_ptr exception;
+        try
+        {
+            record->Update(state);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(CurrentGamesMutex);
+            CurrentGames[std::this_thread::get_id()].IsUpdating = false;
+        }
+        if (exception != nullptr)
+            std::rethrow_exception(exception);
+    }
+
+    std::unique_ptr<EvolvingAI::GameRecord> EvolvingAI::TakeGameRecord(const Logic& game_over_state)
+    {
+        std::lock_guard<std::mutex> lock(CurrentGamesMutex);
+        auto current_game = CurrentGames.find(std::this_thread::get_id());
+        if (current_game == CurrentGames.end() || !current_game->second.Record->IsOf(game_over_state))
+            return nullptr;
+        auto record = std::move(current_game->second.Record);
+        CurrentGames.erase(current_game);
+        return record;
+    }
+
+    /// @brief The free records kept for reuse, about 135 KB each.
+    constexpr int EVOLVING_AI_MAX_FREE_GAME_RECORDS = 4;
+    /// @brief The moves observed on the other threads after which the game of a thread is abandoned,
+    ///        about 64 games. An abandoned game that is learned anyway is recorded when it's learned.
+    constexpr unsigned long long EVOLVING_AI_ABANDONED_GAME_OBSERVATIONS = 64 * 60;
+
+    std::unique_ptr<EvolvingAI::GameRecord> EvolvingAI::AcquireGameRecord()
+    {
+        std::unique_ptr<GameRecord> record;
+        {
+            std::lock_guard<std::mutex> lock(CurrentGamesMutex);
+            if (FreeGameRecords.empty())
+                return std::make_unique<GameRecord>();
+            record = std::move(FreeGameRecords.back());
+            FreeGameRecords.pop_back();
+        }
+        record->Reset();
+        return record;
+    }
+
+    void EvolvingAI::ReleaseGameRecord(std::unique_ptr<GameRecord> record)
+    {
+        std::lock_guard<std::mutex> lock(CurrentGamesMutex);
+        if (FreeGameRecords.size() < EVOLVING_AI_MAX_FREE_GAME_RECORDS)
+            FreeGameRecords.push_back(std::move(record));
+    }
+
+    void EvolvingAI::PruneCurrentGames()
+    {
+        for (auto current_game = CurrentGames.begin(); current_game != CurrentGames.end();)
+        {
+            if (current_game->second.IsUpdating
+                || ObservationsCount - current_game->second.LastObservation <= EVOLVING_AI_ABANDONED_GAME_OBSERVATIONS)
+            {
+                current_game++;
+                continue;
+            }
+            if (FreeGameRecords.size() < EVOLVING_AI_MAX_FREE_GAME_RECORDS)
+                FreeGameRecords.push_back(std::move(current_game->second.Record));
+            current_game = CurrentGames.erase(current_game);
+        }
+    }
+
+    void EvolvingAI::LearnGame(const Logic& game_over_state, std::unique_ptr<GameRecord> record)
+    {
+        if (record == nullptr)
+        {
+            // The moves weren't observed, so they're recorded now
+            record = AcquireGameRecord();
+            record->Update(game_over_state);
+        }
         int black_count = 0;
         int white_count = 0;
         for (int x = 0; x < 8; x++)
@@ -245,194 +564,97 @@ namespace Reversi
                     EVOLVING_AI_LEARNING_WIN_BASE_FEEDBACK : -EVOLVING_AI_LEARNING_WIN_BASE_FEEDBACK));
         float white_learning_feedback = -black_learning_feedback;
 
-        // Calculate move impacts by simulating the game again
-
-        /// @brief Simulation state
-        Logic state;
-        /// @brief Move causing the impacts & direction of it -> Impact location -> Impact (latest change and impact factor)
-        std::map<std::tuple<Logic::Change, int>, std::map<std::tuple<int, int>, std::shared_ptr<std::tuple<Logic::Change, float>>>> move_to_impacts;
-        /// @brief Impacts location -> Move causing the impact & direction of it -> Impact (latest change and impact factor)
-        std::map<std::tuple<int, int>, std::map<std::tuple<Logic::Change, int>, std::shared_ptr<std::tuple<Logic::Change, float>>>> location_to_impacts;
-        /// @brief Features calculated from simulation states and stored for learning at the end.
-        std::map<Logic::Change, std::vector<Features>> move_to_features;
-        /// @brief Adds impact, replacing if there's an old impact in place with lower factor.
-        auto add_impact = [&](std::tuple<Logic::Change, int> original_move, std::shared_ptr<std::tuple<Logic::Change, float>> new_impact)
-        {
-            auto location = std::make_tuple(get<0>(*new_impact).X, get<0>(*new_impact).Y);
-            if (move_to_impacts[original_move].contains(location)
-                    && get<1>(*move_to_impacts[original_move][location])
-                        > get<1>(*new_impact)) // The existing impact has a higher impact score
-                return;
-            move_to_impacts[original_move][location] = new_impact;
-            location_to_impacts[location][original_move] = new_impact;
-        };
+        int moves_count = record->MovesCount;
+        auto& arena = ThreadPool::GetScratchArena();
+        auto arena_mark = arena.GetMark();
+        const Side* move_sides = record->MoveSides;
+        const Features* move_features = record->MoveFeatures;
 #if REVERSI_DEBUG
         // Learn debug info
-        std::map<Logic::Change, std::tuple<Logic, Logic>> move_to_states;
-        /// @brief Move -> Direction -> Feedback
-        std::map<Logic::Change, std::map<int, float>> move_to_feedbacks;
-#endif
-        for (const auto& move : game_over_state.GetHistory())
-        {
-            auto move_action = move.Changes[0];
-            auto turn = state.GetCurrentTurn();
-            if (turn == Side::None || turn != move_action.NewState)
-                throw std::logic_error("Wrong game history.");
-            auto features = GetFeatures(state, move_action.X, move_action.Y);
-            move_to_features[move_action] = features;
-            for (const auto& change : move.Changes)
-            {
-                auto location = std::make_tuple(change.X, change.Y);
-                // Add/update indirect impacts (root: the flipped disks)
-                if (change.OldState != Side::None)
-                {
-                    for (const auto& [original_move, existing_impact] : location_to_impacts[location])
-                    {
-                        float new_impact_factor =
-                            std::get<1>(*existing_impact)
-                            * EVOLVING_AI_LEARNING_IMPACT_REDUCTION_COEFFICIENT;
-                        // Update impact (where a disk is flipped)
-                        std::get<0>(*existing_impact) = change;
-                        std::get<1>(*existing_impact) = new_impact_factor;
-                        // Add impact (where the disk is placed: move_action)
-                        auto new_impact = std::make_shared<std::tuple<Logic::Change, float>>(move_action, new_impact_factor);
-                        add_impact(original_move, new_impact);
-                    }
-                }
-            }
-            for (const auto& end : move.Ends)
+        const auto& history = game_over_state.GetHistory();
+        std::vector<std::tuple<Logic, Logic>> move_states;
+        {
+            Logic state;
+            for (const auto& move : history)
             {
-                // Add indirect impacts (root: the unchanged end disks that caused flips)
-                auto end_location = std::make_tuple(end.X, end.Y);
-                for (const auto& change : move.Changes)
-                {
-                    auto change_location = std::make_tuple(change.X, change.Y);
-                    if (change.OldState == Side::None || (
-                            sign(change.X - move_action.X) == sign(end.X - move_action.X)
-                            &&
-                            sign(change.Y - move_action.Y) == sign(end.Y - move_action.Y)
-                        ))
-                    {
-                        for (const auto& [original_move, existing_impact] : location_to_impacts[end_location])
-                        {
-                            float new_impact_factor =
-                                std::get<1>(*existing_impact)
-                                * EVOLVING_AI_LEARNING_IMPACT_REDUCTION_COEFFICIENT;
-                            auto new_impact = std::make_shared<std::tuple<Logic::Change, float>>(change, new_impact_factor);
-                            add_impact(original_move, new_impact);
-                        }
-                    }
-                }
+                auto prev_state = state;
+                state.MakeMove(move.Changes[0].X, move.Changes[0].Y);
+                move_states.push_back(std::make_tuple(prev_state, state));
             }
-            for (const auto& change : move.Changes)
-            {
-                auto location = std::make_tuple(change.X, change.Y);
-                // Add direct impacts (caused by the new move)
-                auto impact = std::make_shared<std::tuple<Logic::Change, float>>(change, 1);
-                if (change.X == move_action.X && change.Y == move_action.Y)
-                {
-                    for (int i = 0; i < 8; i++)
-                    {
-                        auto original_move = std::make_tuple(move_action, i);
-                        move_to_impacts[original_move][location] = impact;
-                        location_to_impacts[location][original_move] = impact;
-                    }
-                }
-                else
-                {
-                    int direction = GetGeneralizedDirection(
-                        move_action.X, move_action.Y,
-                        change.X - move_action.X,
-                        change.Y - move_action.Y
-                    );
-                    auto original_move = std::make_tuple(move_action, direction);
-                    move_to_impacts[original_move][location] = impact;
-                    location_to_impacts[location][original_move] = impact;
-                }
-            }
-#if REVERSI_DEBUG
-            // Learn debug info
-            auto prev_state = state;
-#endif
-            state.MakeMove(move_action.X, move_action.Y);
-#if REVERSI_DEBUG
-            // Learn debug info
-            move_to_states[move_action] = std::make_tuple(prev_state, state);
-#endif
         }
+        /// @brief Move index -> Direction -> Feedback
+        std::vector<std::map<int, float>> move_feedbacks(moves_count);
+#endif
 
-        // Calculate raw impacts for learning
-        std::map<std::tuple<Logic::Change, int>, float> move_to_raw_impact;
+        // Calculate raw impacts for learning, summing the slots in the same order as before the arrays,
+        // so that the learned data doesn't change
+        int winner_slots[64];
+        int winner_slots_count = 0;
+        for (int x = 0; x < 8; x++)
+            for (int y = 0; y < 8; y++)
+                if (game_over_state.Get(x, y) == game_over_state.GetWinner())
+                    winner_slots[winner_slots_count++] = y << 3 | x;
+        /// @brief Move index -> Direction -> Raw impact
+        float* raw_impacts = arena.AllocateArray<float>(moves_count * 8);
         float max_raw_black_impact = 0.000001;
         float max_raw_white_impact = 0.000001;
-        for (const auto& item : move_to_impacts)
+        for (int i = 0; i < moves_count; i++)
         {
-            std::map<std::tuple<int, int>, float> location_to_impact;
-            for (const auto& impact : item.second)
+            for (int direction = 0; direction < 8; direction++)
             {
-                auto impact_change = std::get<0>(*impact.second);
-                float impact_number = std::get<1>(*impact.second);
-                if (impact_change.NewState == game_over_state.GetWinner())
+                float raw_impact = 0;
+                for (int j = 0; j < winner_slots_count; j++)
+                    raw_impact += record->ImpactAt(winner_slots[j], i, direction);
+                raw_impacts[i * 8 + direction] = raw_impact;
+                if (move_sides[i] == Side::Black)
                 {
-                    auto location = std::make_tuple(impact_change.X, impact_change.Y);
-                    if (location_to_impact.contains(location))
-                    {
-                        if (impact_number > location_to_impact[location])
-                            location_to_impact[location] = impact_number;
-                    }
-                    else
-                    {
-                        location_to_impact[location] = impact_number;
-                    }
+                    if (raw_impact > max_raw_black_impact)
+                        max_raw_black_impact = raw_impact;
                 }
-#if REVERSI_DEBUG
-                // CHECK
-                if (game_over_state.Get(impact_change.X, impact_change.Y) != impact_change.NewState)
+                else
                 {
-                    throw std::logic_error("This is a bug. Mismatch between final impact & game over state.");
+                    if (raw_impact > max_raw_white_impact)
+                        max_raw_white_impact = raw_impact;
                 }
-#endif
-            }
-            float raw_impact = 0;
-            for (const auto& item : location_to_impact)
-            {
-                raw_impact += item.second;
-            }
-            move_to_raw_impact[item.first] = raw_impact;
-            if (std::get<0>(item.first).NewState == Side::Black)
-            {
-                if (raw_impact > max_raw_black_impact)
-                    max_raw_black_impact = raw_impact;
-            }
-            else if (std::get<0>(item.first).NewState == Side::White)
-            {
-                if (raw_impact > max_raw_white_impact)
-                    max_raw_white_impact = raw_impact;
-            }
-            else
-            {
-                throw std::logic_error("Wrong game history, or a bug.");
             }
         }
 
-        // Learn
-        for (const auto& [move, move_features] : move_to_features)
+        // Learn, in the order of the move slots, all of the game at once for the readers of the data
+        int slot_to_move[64];
+        std::fill(slot_to_move, slot_to_move + 64, -1);
+        for (int i = 0; i < moves_count; i++)
+            slot_to_move[record->MoveSlots[i]] = i;
+        std::vector<int> changed_cells;
         {
-            bool is_black = move.NewState == Side::Black;
-            for (const auto& features : move_features)
+            std::unique_lock<std::shared_mutex> lock(DataMutex);
+            for (int x = 0; x < 8; x++)
             {
-                auto move_and_direction = std::make_tuple(move, features.Direction);
-                /// @brief Normalized impact
-                float impact = move_to_raw_impact[move_and_direction] / (is_black ? max_raw_black_impact : max_raw_white_impact);
-                float feedback = impact * (is_black ? black_learning_feedback : white_learning_feedback);
+                for (int y = 0; y < 8; y++)
+                {
+                    int i = slot_to_move[y << 3 | x];
+                    if (i < 0)
+                        continue;
+                    bool is_black = move_sides[i] == Side::Black;
+                    for (int j = 0; j < 8; j++)
+                    {
+                        const auto& features = move_features[i * 8 + j];
+                        /// @brief Normalized impact
+                        float impact = raw_impacts[i * 8 + features.Direction] / (is_black ? max_raw_black_impact : max_raw_white_impact);
+                        float feedback = impact * (is_black ? black_learning_feedback : white_learning_feedback);
 #if REVERSI_DEBUG
-                // Learn debug info
-                move_to_feedbacks[move][features.Direction] = feedback;
+                        // Learn debug info
+                        move_feedbacks[i][features.Direction] = feedback;
 #endif
-                // Learn based on impact-based feedback
-                Learn(features, feedback);
+                        // Learn based on impact-based feedback
+                        Learn(features, feedback,
+                            DataStorage == Storage::Rewrite || DataStorage == Storage::Journal ? &changed_cells : nullptr);
+                    }
+                }
             }
+            InvalidateScoreCache();
         }
+        arena.Rewind(arena_mark);
+        ReleaseGameRecord(std::move(record));
 #if REVERSI_DEBUG
         // Learn debug info
         Log("----------------------------------");
@@ -441,9 +663,10 @@ namespace Reversi
         Log("Overall black learning feedback:");
         Log(std::to_string(black_learning_feedback));
         Log("----------------------------------");
-        for (const auto& move : game_over_state.GetHistory())
+        int move_index = 0;
+        for (const auto& move : history)
         {
-            auto feedbacks = move_to_feedbacks[move.Changes[0]];
+            const auto& feedbacks = move_feedbacks[move_index];
             Log(std::string("Learn with feedback { "), "");
             for (const auto& [direction, feedback] : feedbacks)
             {
@@ -453,7 +676,7 @@ namespace Reversi
                 Log(":" + std::to_string(feedback), " ");
             }
             Log("}:");
-            auto& [ before, after ] = move_to_states[move.Changes[0]];
+            auto& [ before, after ] = move_states[move_index++];
             for (int y = 7; y >= 0; y--)
             {
                 for (int x = 0; x < 8; x++)
@@ -486,47 +709,274 @@ namespace Reversi
         Log(std::to_string(white_learning_feedback));
         Log("----------------------------------");
 #endif
-        Save();
+        SaveLearned(changed_cells);
+    }
+
+    void EvolvingAI::QueueLearning(const Logic& game_over_state)
+    {
+        if (!game_over_state.IsGameOver() || LearningRate == 0)
+            return;
+        auto record = TakeGameRecord(game_over_state);
+        std::lock_guard<std::mutex> lock(LearningQueueMutex);
+        LearningQueue.push_back(QueuedGame { game_over_state, std::move(record) });
+        if (!IsLearningQueue)
+        {
+            IsLearningQueue = true;
+            LearningTask.Run([this]() { LearnQueue(); });
+        }
+    }
+
+    void EvolvingAI::WaitForLearning()
+    {
+        LearningTask.Wait();
+    }
+
+    void EvolvingAI::LearnQueue()
+    {
+        while (true)
+        {
+            QueuedGame game;
+            {
+                std::lock_guard<std::mutex> lock(LearningQueueMutex);
+                if (LearningQueue.empty())
+                {
+                    IsLearningQueue = false;
+                    return;
+                }
+                game = std::move(LearningQueue.front());
+                LearningQueue.pop_front();
+            }
+            try
+            {
+                LearnGame(game.GameOverState, std::move(game.Record));
+            }
+            catch (...)
+            {
+                // The next queued game starts a new task
+                std::lock_guard<std::mutex> lock(LearningQueueMutex);
+                IsLearningQueue = false;
+                throw;
+            }
+        }
+    }
+
+    /// @brief The score of 128 of the one byte cells.
+    constexpr unsigned short EVOLVING_AI_FILE_DEFAULT_DATA_VALUE = 128 * 257;
+    constexpr unsigned short EVOLVING_AI_MAX_DATA_VALUE = 65535;
+    constexpr unsigned short EVOLVING_AI_MAX_VISITS = 65535;
+    constexpr unsigned char EVOLVING_AI_FILE_HEADER[] = {
+        0xFF,
+        'R','e','m','i','n','i','m','a','l','i','s','m','.','R','e','v','e','r','s','i','.','E','v','o','l','v','i','n','g','A','I',
+        0xFF
+    };
+    /// @brief The header and the version are followed by zeros up to EVOLVING_AI_FILE_DATA_OFFSET,
+    ///        then the 16-bit cells of EvolvingAI::Data and the 16-bit EvolvingAI::Visits.
+    constexpr unsigned char EVOLVING_AI_FILE_VERSION[] = { 0, 0, 0, 3 };
+    /// @brief The version with one byte cells in the current order, 0 to 255 for the scores 0 to 1,
+    ///        right after the version, migrated on load.
+    constexpr unsigned char EVOLVING_AI_FILE_VERSION_2[] = { 0, 0, 0, 2 };
+    /// @brief The version with one byte cells in GeneralizedPlace, Direction, NeighborCount, AffectedDisksCount,
+    ///        NeighborColorChangeCount, IslandsCount order, right after the version, migrated on load.
+    constexpr unsigned char EVOLVING_AI_FILE_VERSION_1[] = { 0, 0, 0, 1 };
+    /// @brief A cache line, so that the cells are aligned for the atomics and the cache lines as in memory when mapped.
+    constexpr int EVOLVING_AI_FILE_DATA_OFFSET = 64;
+    constexpr int EVOLVING_AI_FILE_SIZE = EVOLVING_AI_FILE_DATA_OFFSET + EvolvingAI::DATA_SIZE * 2 * sizeof(unsigned short);
+    /// @brief Followed by EVOLVING_AI_FILE_VERSION, as the journal is of the cells of that version.
+    ///
+    /// Then a record for each learned game: the number of the entries, the entries and the checksum of them,
+    /// all unsigned ints. An entry is two unsigned ints, the index of a cell, and the new visit count of it
+    /// shifted left by 16 bits with the new value of it.
+    /// The entries are new values rather than differences, so replaying a record again changes nothing.
+    ///
+    /// The entries of a journal of EVOLVING_AI_FILE_VERSION_2 are an unsigned int each, the index of a cell
+    /// shifted left by 8 bits with the new one byte value of it.
+    constexpr unsigned char EVOLVING_AI_JOURNAL_HEADER[] = {
+        0xFF,
+        'R','e','m','i','n','i','m','a','l','i','s','m','.','R','e','v','e','r','s','i','.','E','v','o','l','v','i','n','g','A','I',
+        '.','J','o','u','r','n','a','l',
+        0xFF
+    };
+    constexpr int EVOLVING_AI_JOURNAL_RECORDS_OFFSET = sizeof(EVOLVING_AI_JOURNAL_HEADER) + sizeof(EVOLVING_AI_FILE_VERSION);
+    /// @brief The journal is compacted when it's larger than the data file,
+    ///        so loading never reads more than twice the data file.
+    constexpr long long EVOLVING_AI_JOURNAL_COMPACTION_SIZE = EVOLVING_AI_FILE_SIZE;
+    /// @brief The shared file of Storage::Shared is a cache line, starting with the shared generation.
+    constexpr int EVOLVING_AI_SHARED_FILE_SIZE = 64;
+
+    unsigned int evolving_ai_journal_checksum(const unsigned int* entries, unsigned int count)
+    {
+        unsigned int result = count;
+        for (unsigned int i = 0; i < count; i++)
+            result = result * 0x01000193 ^ entries[i];
+        return result;
+    }
+
+    /// @brief Writes a temporary file and renames it to the data file,
+    ///        so that a crash while writing leaves the previous data file.
+    /// @param data The cells followed by the visit counts.
+    void evolving_ai_write_data_file(const std::string& path, const unsigned short* data)
+    {
+        std::string temporary_path = path + ".tmp";
+        {
+            std::fstream file(temporary_path, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+            file.write((char*)EVOLVING_AI_FILE_HEADER, sizeof(EVOLVING_AI_FILE_HEADER));
+            file.write((char*)EVOLVING_AI_FILE_VERSION, sizeof(EVOLVING_AI_FILE_VERSION));
+            const char padding[EVOLVING_AI_FILE_DATA_OFFSET] = {};
+            file.write(padding, EVOLVING_AI_FILE_DATA_OFFSET - sizeof(EVOLVING_AI_FILE_HEADER) - sizeof(EVOLVING_AI_FILE_VERSION));
+            file.write((char*)data, EvolvingAI::DATA_SIZE * 2 * sizeof(unsigned short));
+            if (!file)
+                throw std::runtime_error("Can't write the EvolvingAI data file: " + temporary_path);
+        }
+        std::filesystem::rename(temporary_path, path);
+    }
+
+    /// @brief Writes the cells of the data and their visit counts into the current data file in place.
+    void evolving_ai_write_data_cells(const std::string& path, const unsigned short* data, const std::vector<int>& cells)
+    {
+        std::fstream file(path, std::fstream::binary | std::fstream::in | std::fstream::out);
+        for (int cell : cells)
+        {
+            file.seekp(EVOLVING_AI_FILE_DATA_OFFSET + cell * sizeof(unsigned short));
+            file.write((char*)(data + cell), sizeof(unsigned short));
+            file.seekp(EVOLVING_AI_FILE_DATA_OFFSET + (EvolvingAI::DATA_SIZE + cell) * sizeof(unsigned short));
+            file.write((char*)(data + EvolvingAI::DATA_SIZE + cell), sizeof(unsigned short));
+        }
+        if (!file)
+            throw std::runtime_error("Can't write the EvolvingAI data file: " + path);
+    }
+
+    void EvolvingAI::ResetData()
+    {
+        for (int i = 0; i < DATA_SIZE; i++)
+        {
+            Data[i] = EVOLVING_AI_FILE_DEFAULT_DATA_VALUE;
+            Visits[i] = 0;
+        }
+    }
+
+    void EvolvingAI::InvalidateScoreCache()
+    {
+        // Released after the changes, so that a thread that sees the new salt caches the new scores
+        ScoreCacheSalt.store((++evolving_ai_score_cache_generation) * 0xBF58476D1CE4E5B9ULL, std::memory_order_release);
+        if (SharedGeneration != nullptr)
+            std::atomic_ref<unsigned long long>(*SharedGeneration).fetch_add(1, std::memory_order_release);
+    }
+
+    unsigned long long EvolvingAI::GetScoreCacheSalt()
+    {
+        auto salt = ScoreCacheSalt.load(std::memory_order_acquire);
+        if (SharedGeneration != nullptr)
+            salt += std::atomic_ref<unsigned long long>(*SharedGeneration).load(std::memory_order_acquire) * 0x94D049BB133111EBULL;
+        return salt;
+    }
+
+    std::string EvolvingAI::GetBackupPath(const std::string& path, bool unsupported_file)
+    {
+        int i = 0;
+        while (std::filesystem::exists(path + "." + std::to_string(i) + (unsupported_file ? ".unsupported-file-backup" : ".backup")))
+            i++;
+        return path + "." + std::to_string(i) + (unsupported_file ? ".unsupported-file-backup" : ".backup");
     }
 
-    constexpr unsigned char EVOLVING_AI_FILE_DEFAULT_DATA_VALUE = 128;
-    constexpr unsigned char EVOLVING_AI_FILE_HEADER[] = {
-        0xFF,
-        'R','e','m','i','n','i','m','a','l','i','s','m','.','R','e','v','e','r','s','i','.','E','v','o','l','v','i','n','g','A','I',
-        0xFF
-    };
-    constexpr unsigned char EVOLVING_AI_FILE_VERSION[] = { 0, 0, 0, 1 };
+    void EvolvingAI::RenameToBackup(const std::string& path, bool unsupported_file)
+    {
+        std::filesystem::rename(path, GetBackupPath(path, unsupported_file));
+    }
 
-    void EvolvingAI::ResetData()
+    bool EvolvingAI::IsCurrentFile()
+    {
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(DataFilePath, error)
+            || std::filesystem::file_size(DataFilePath, error) != EVOLVING_AI_FILE_SIZE)
+            return false;
+        std::fstream file(DataFilePath, std::fstream::binary | std::fstream::in);
+        unsigned char file_check[sizeof(EVOLVING_AI_FILE_HEADER) + sizeof(EVOLVING_AI_FILE_VERSION)];
+        file.read((char*)file_check, sizeof(file_check));
+        return file
+            && std::equal(EVOLVING_AI_FILE_HEADER, EVOLVING_AI_FILE_HEADER + sizeof(EVOLVING_AI_FILE_HEADER), file_check)
+            && std::equal(EVOLVING_AI_FILE_VERSION, EVOLVING_AI_FILE_VERSION + sizeof(EVOLVING_AI_FILE_VERSION),
+                file_check + sizeof(EVOLVING_AI_FILE_HEADER));
+    }
+
+    bool EvolvingAI::LockDataFile(std::optional<FileLock>& lock)
+    {
+        lock.emplace(SharedFilePath, false, false);
+        if (lock->IsLocked())
+            return true;
+        // Held shared by the processes that have the data file mapped, or exclusively by one that is replacing it,
+        // which is waited for before trying again
+        lock.emplace(SharedFilePath, true);
+        lock.emplace(SharedFilePath, false, false);
+        if (lock->IsLocked())
+            return true;
+        lock.emplace(SharedFilePath, true);
+        return false;
+    }
+
+    void EvolvingAI::Load()
     {
-        for (int i = 0; i < sizeof(Data); i++)
+        bool is_mapped = DataStorage == Storage::Mapped || DataStorage == Storage::Shared;
+        if (is_mapped && MapCurrentFile())
+            return;
         {
-            Data[i] = EVOLVING_AI_FILE_DEFAULT_DATA_VALUE;
+            std::optional<FileLock> lock;
+            bool is_replaceable = LockDataFile(lock);
+            if (!is_replaceable && !IsCurrentFile())
+                throw std::runtime_error("Can't migrate the EvolvingAI data file while other processes have it mapped: " + DataFilePath);
+            bool is_current_file = ReadFile();
+            bool is_current_journal;
+            std::vector<int> journal_cells;
+            bool has_journal = ReplayJournal(is_current_journal, journal_cells);
+            // A journal is only kept with Storage::Journal, and only if it's of the current version.
+            // The old journal is removed after the migrated data including it replaces the data file,
+            // so that a crash in between leaves the old data file and the journal, or the new one and the journal.
+            if (!is_current_file || (has_journal && (DataStorage != Storage::Journal || !is_current_journal)))
+                Save(is_replaceable ? nullptr : &journal_cells);
+            else if (has_journal)
+                UncompactedCells = journal_cells;
+            if (DataStorage == Storage::Journal)
+                OpenJournal();
         }
+        if (is_mapped && !MapCurrentFile())
+            throw std::runtime_error("The EvolvingAI data file changed while it was being loaded: " + DataFilePath);
     }
 
-    void EvolvingAI::RenameToBackup(bool unsupported_file)
+    bool EvolvingAI::MapCurrentFile()
     {
-        int i = 0;
-        while (std::filesystem::exists(DataFilePath + "." + std::to_string(i) + (unsupported_file ? ".unsupported-file-backup" : ".backup")))
-            i++;
-        std::filesystem::rename(DataFilePath, DataFilePath + "." + std::to_string(i) + (unsupported_file ? ".unsupported-file-backup" : ".backup"));
+        SharedLock = std::make_unique<FileLock>(SharedFilePath, true);
+        if (!IsCurrentFile())
+        {
+            SharedLock.reset();
+            return false;
+        }
+        if (DataStorage == Storage::Shared)
+            MapSharedFile();
+        MapFile();
+        // Applied in place, as the other processes may have the data file mapped
+        bool is_current_journal;
+        std::vector<int> journal_cells;
+        if (ReplayJournal(is_current_journal, journal_cells))
+        {
+            std::error_code error;
+            std::filesystem::remove(JournalFilePath, error);
+        }
+        return true;
     }
 
-    void EvolvingAI::Load()
+    bool EvolvingAI::ReadFile()
     {
         if (!std::filesystem::exists(DataFilePath))
         {
             ResetData();
             Save();
-            return;
+            return true;
         }
         else if (std::filesystem::is_directory(DataFilePath))
         {
-            RenameToBackup(true);
+            RenameToBackup(DataFilePath, true);
             ResetData();
             Save();
-            return;
+            return true;
         }
         std::fstream file(DataFilePath, std::fstream::binary | std::fstream::in);
         unsigned char file_check[sizeof(EVOLVING_AI_FILE_HEADER)];
@@ -535,53 +985,304 @@ namespace Reversi
         {
             if (EVOLVING_AI_FILE_HEADER[i] != file_check[i])
             {
-                RenameToBackup(true);
+                RenameToBackup(DataFilePath, true);
                 ResetData();
                 Save();
-                return;
+                return true;
             }
         }
         file.read((char*)file_check, sizeof(EVOLVING_AI_FILE_VERSION));
-        for (int i = 0; i < sizeof(EVOLVING_AI_FILE_VERSION); i++)
+        bool is_version_1 = std::equal(EVOLVING_AI_FILE_VERSION_1, EVOLVING_AI_FILE_VERSION_1 + sizeof(EVOLVING_AI_FILE_VERSION_1), file_check);
+        bool is_version_2 = std::equal(EVOLVING_AI_FILE_VERSION_2, EVOLVING_AI_FILE_VERSION_2 + sizeof(EVOLVING_AI_FILE_VERSION_2), file_check);
+        bool is_current_version = std::equal(EVOLVING_AI_FILE_VERSION, EVOLVING_AI_FILE_VERSION + sizeof(EVOLVING_AI_FILE_VERSION), file_check);
+        std::vector<unsigned char> old_data;
+        if (is_version_1 || is_version_2)
+        {
+            old_data.resize(DATA_SIZE);
+            file.read((char*)old_data.data(), old_data.size());
+        }
+        else if (is_current_version)
+        {
+            file.seekg(EVOLVING_AI_FILE_DATA_OFFSET);
+            file.read((char*)Data, DATA_SIZE * 2 * sizeof(unsigned short));
+        }
+        if (!file || !(is_version_1 || is_version_2 || is_current_version))
         {
-            if (EVOLVING_AI_FILE_VERSION[i] != file_check[i])
+            file.close();
+            RenameToBackup(DataFilePath, true);
+            ResetData();
+            Save();
+            return true;
+        }
+        file.close();
+        if (is_current_version)
+            return true;
+
+        // The one byte scores are scaled to the same scores, and the cells haven't been visited yet
+        if (is_version_1)
+        {
+            int old_index = 0;
+            Features features;
+            for (features.GeneralizedPlace = 0; features.GeneralizedPlace < 10; features.GeneralizedPlace++)
+                for (features.Direction = 0; features.Direction < 8; features.Direction++)
+                    for (features.NeighborCount = 0; features.NeighborCount < 8; features.NeighborCount++)
+                        for (features.AffectedDisksCount = 0; features.AffectedDisksCount < 7; features.AffectedDisksCount++)
+                            for (features.NeighborColorChangeCount = 0; features.NeighborColorChangeCount < 7; features.NeighborColorChangeCount++)
+                                for (features.IslandsCount = 0; features.IslandsCount < 5; features.IslandsCount++)
+                                    DataAt(features) = old_data[old_index++] * 257;
+        }
+        else
+        {
+            for (int i = 0; i < DATA_SIZE; i++)
+                Data[i] = old_data[i] * 257;
+        }
+        std::fill(Visits, Visits + DATA_SIZE, 0);
+        // The old file is kept until the migrated data replaces it
+        std::filesystem::copy_file(DataFilePath, GetBackupPath(DataFilePath, false));
+        return false;
+    }
+
+    void EvolvingAI::MapFile()
+    {
+        DataMapping = std::make_unique<MappedFile>(DataFilePath);
+        if (DataMapping->GetSize() != EVOLVING_AI_FILE_SIZE)
+        {
+            DataMapping.reset();
+            throw std::runtime_error("The EvolvingAI data file changed while it was being mapped: " + DataFilePath);
+        }
+        Data = (unsigned short*)(DataMapping->GetData() + EVOLVING_AI_FILE_DATA_OFFSET);
+        Visits = Data + DATA_SIZE;
+        DataBuffer.reset();
+    }
+
+    void EvolvingAI::MapSharedFile()
+    {
+        // The cells and the generation are changed by the processes with lock-free atomics, which don't depend on the address
+        static_assert(std::atomic_ref<unsigned short>::is_always_lock_free && std::atomic_ref<unsigned long long>::is_always_lock_free);
+        if (std::filesystem::file_size(SharedFilePath) < EVOLVING_AI_SHARED_FILE_SIZE)
+            std::filesystem::resize_file(SharedFilePath, EVOLVING_AI_SHARED_FILE_SIZE);
+        SharedMapping = std::make_unique<MappedFile>(SharedFilePath);
+        SharedGeneration = (unsigned long long*)SharedMapping->GetData();
+    }
+
+    bool EvolvingAI::ReplayJournal(bool& is_current_journal, std::vector<int>& cells)
+    {
+        is_current_journal = false;
+        cells.clear();
+        if (!std::filesystem::exists(JournalFilePath))
+            return false;
+        std::fstream file(JournalFilePath, std::fstream::binary | std::fstream::in);
+        unsigned char file_check[EVOLVING_AI_JOURNAL_RECORDS_OFFSET];
+        file.read((char*)file_check, EVOLVING_AI_JOURNAL_RECORDS_OFFSET);
+        bool is_journal = file
+            && std::equal(EVOLVING_AI_JOURNAL_HEADER, EVOLVING_AI_JOURNAL_HEADER + sizeof(EVOLVING_AI_JOURNAL_HEADER), file_check);
+        const unsigned char* version = file_check + sizeof(EVOLVING_AI_JOURNAL_HEADER);
+        is_current_journal = is_journal && std::equal(EVOLVING_AI_FILE_VERSION, EVOLVING_AI_FILE_VERSION + sizeof(EVOLVING_AI_FILE_VERSION), version);
+        bool is_version_2 = is_journal && std::equal(EVOLVING_AI_FILE_VERSION_2, EVOLVING_AI_FILE_VERSION_2 + sizeof(EVOLVING_AI_FILE_VERSION_2), version);
+        if (!is_current_journal && !is_version_2)
+        {
+            // Of another version or not a journal at all, so it can't be applied to the data
+            file.close();
+            RenameToBackup(JournalFilePath, true);
+            return false;
+        }
+        unsigned int entry_size = is_current_journal ? 2 : 1;
+        long long valid_size = EVOLVING_AI_JOURNAL_RECORDS_OFFSET;
+        std::vector<unsigned int> entries;
+        while (true)
+        {
+            unsigned int count;
+            if (!file.read((char*)&count, sizeof(count)) || count > DATA_SIZE)
+                break;
+            entries.resize(count * entry_size + 1);
+            if (!file.read((char*)entries.data(), entries.size() * sizeof(unsigned int))
+                || entries[count * entry_size] != evolving_ai_journal_checksum(entries.data(), count * entry_size))
+                break;
+            for (unsigned int i = 0; i < count; i++)
             {
-                RenameToBackup(true);
-                ResetData();
-                Save();
-                return;
+                if (!is_current_journal)
+                {
+                    // Scaled as the migrated data of version 2
+                    if ((entries[i] >> 8) < DATA_SIZE)
+                    {
+                        evolving_ai_store_cell(Data[entries[i] >> 8], (entries[i] & 0xFF) * 257);
+                        cells.push_back(entries[i] >> 8);
+                    }
+                }
+                else if (entries[i * 2] < DATA_SIZE)
+                {
+                    evolving_ai_store_cell(Data[entries[i * 2]], (unsigned short)entries[i * 2 + 1]);
+                    evolving_ai_store_cell(Visits[entries[i * 2]], (unsigned short)(entries[i * 2 + 1] >> 16));
+                    cells.push_back(entries[i * 2]);
+                }
+            }
+            valid_size += (count * entry_size + 2) * sizeof(unsigned int);
+        }
+        file.close();
+        if (std::filesystem::file_size(JournalFilePath) != valid_size)
+            std::filesystem::resize_file(JournalFilePath, valid_size);
+        return true;
+    }
+
+    void EvolvingAI::OpenJournal()
+    {
+        if (!std::filesystem::exists(JournalFilePath))
+        {
+            std::fstream file(JournalFilePath, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+            file.write((char*)EVOLVING_AI_JOURNAL_HEADER, sizeof(EVOLVING_AI_JOURNAL_HEADER));
+            file.write((char*)EVOLVING_AI_FILE_VERSION, sizeof(EVOLVING_AI_FILE_VERSION));
+        }
+        JournalSize = std::filesystem::file_size(JournalFilePath);
+    }
+
+    void EvolvingAI::Save(const std::vector<int>* cells)
+    {
+        if (cells == nullptr)
+            evolving_ai_write_data_file(DataFilePath, CopyData().data());
+        else
+            evolving_ai_write_data_cells(DataFilePath, CopyData().data(), *cells);
+        std::error_code error;
+        std::filesystem::remove(JournalFilePath, error);
+    }
+
+    void EvolvingAI::SaveLearned(std::vector<int>& changed_cells)
+    {
+        std::lock_guard<std::mutex> lock(SaveMutex);
+        switch (DataStorage)
+        {
+        case Storage::Rewrite:
+            {
+                std::optional<FileLock> lock;
+                if (LockDataFile(lock))
+                    Save();
+                else
+                    evolving_ai_write_data_cells(DataFilePath, CopyData().data(), changed_cells);
+            }
+            break;
+        case Storage::Mapped:
+        case Storage::Shared:
+            // The changes are already in the file
+            if (FlushInterval > 0 && ++UnflushedGamesCount >= FlushInterval)
+            {
+                DataMapping->Flush();
+                UnflushedGamesCount = 0;
             }
+            break;
+        case Storage::Journal:
+            AppendJournal(changed_cells);
+            break;
+        }
+    }
+
+    void EvolvingAI::AppendJournal(std::vector<int>& changed_cells)
+    {
+        std::sort(changed_cells.begin(), changed_cells.end());
+        changed_cells.erase(std::unique(changed_cells.begin(), changed_cells.end()), changed_cells.end());
+        // The values are read under SaveMutex, so the last record of a cell has the value of its last change,
+        // even if the other learners change it in the meantime
+        std::vector<unsigned int> record;
+        record.reserve(changed_cells.size() * 2 + 2);
+        record.push_back((unsigned int)changed_cells.size());
+        for (int cell : changed_cells)
+        {
+            record.push_back((unsigned int)cell);
+            record.push_back((unsigned int)evolving_ai_load_cell(Visits[cell]) << 16 | evolving_ai_load_cell(Data[cell]));
+        }
+        record.push_back(evolving_ai_journal_checksum(record.data() + 1, (unsigned int)changed_cells.size() * 2));
+
+        std::lock_guard<std::mutex> lock(JournalMutex);
+        {
+            std::fstream file(JournalFilePath, std::fstream::binary | std::fstream::out | std::fstream::app);
+            file.write((char*)record.data(), record.size() * sizeof(unsigned int));
+            if (!file)
+                throw std::runtime_error("Can't append to the EvolvingAI journal: " + JournalFilePath);
+        }
+        JournalSize += record.size() * sizeof(unsigned int);
+        UncompactedCells.insert(UncompactedCells.end(), changed_cells.begin(), changed_cells.end());
+        if (JournalSize > EVOLVING_AI_JOURNAL_COMPACTION_SIZE && !IsCompacting)
+        {
+            IsCompacting = true;
+            auto data = std::make_shared<std::vector<unsigned short>>(CopyData());
+            auto cells = std::make_shared<std::vector<int>>(std::move(UncompactedCells));
+            UncompactedCells.clear();
+            long long compacted_journal_size = JournalSize;
+            CompactionTask.Run([this, data, cells, compacted_journal_size]() { Compact(*data, *cells, compacted_journal_size); });
+        }
+    }
+
+    std::vector<unsigned short> EvolvingAI::CopyData()
+    {
+        std::vector<unsigned short> data(DATA_SIZE * 2);
+        std::shared_lock<std::shared_mutex> lock(DataMutex);
+        for (int i = 0; i < DATA_SIZE; i++)
+        {
+            data[i] = evolving_ai_load_cell(Data[i]);
+            data[DATA_SIZE + i] = evolving_ai_load_cell(Visits[i]);
         }
-        file.read((char*)Data, sizeof(Data));
+        return data;
     }
 
-    void EvolvingAI::Save()
+    void EvolvingAI::Compact(const std::vector<unsigned short>& data, const std::vector<int>& cells, long long compacted_journal_size)
     {
-        std::fstream file(DataFilePath, std::fstream::binary | std::fstream::out | std::fstream::trunc);
-        file.write((char*)EVOLVING_AI_FILE_HEADER, sizeof(EVOLVING_AI_FILE_HEADER));
-        file.write((char*)EVOLVING_AI_FILE_VERSION, sizeof(EVOLVING_AI_FILE_VERSION));
-        file.write((char*)Data, sizeof(Data));
+        try
+        {
+            {
+                std::optional<FileLock> lock;
+                if (LockDataFile(lock))
+                    evolving_ai_write_data_file(DataFilePath, data.data());
+                else
+                    evolving_ai_write_data_cells(DataFilePath, data.data(), cells);
+            }
+            // Until the journal is rewritten, replaying all of it gives the same data, as the entries are new values
+            std::lock_guard<std::mutex> lock(JournalMutex);
+            std::vector<char> appended_records(JournalSize - compacted_journal_size);
+            {
+                std::fstream file(JournalFilePath, std::fstream::binary | std::fstream::in);
+                file.seekg(compacted_journal_size);
+                file.read(appended_records.data(), appended_records.size());
+            }
+            std::string temporary_path = JournalFilePath + ".tmp";
+            {
+                std::fstream file(temporary_path, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+                file.write((char*)EVOLVING_AI_JOURNAL_HEADER, sizeof(EVOLVING_AI_JOURNAL_HEADER));
+                file.write((char*)EVOLVING_AI_FILE_VERSION, sizeof(EVOLVING_AI_FILE_VERSION));
+                file.write(appended_records.data(), appended_records.size());
+                if (!file)
+                    throw std::runtime_error("Can't write the EvolvingAI journal: " + temporary_path);
+            }
+            std::filesystem::rename(temporary_path, JournalFilePath);
+            JournalSize = EVOLVING_AI_JOURNAL_RECORDS_OFFSET + appended_records.size();
+            IsCompacting = false;
+        }
+        catch (...)
+        {
+            // Tried again after the next game
+            std::lock_guard<std::mutex> lock(JournalMutex);
+            UncompactedCells.insert(UncompactedCells.end(), cells.begin(), cells.end());
+            IsCompacting = false;
+            throw;
+        }
     }
 
-    unsigned char& EvolvingAI::DataAt(const Features& features)
+    unsigned short& EvolvingAI::DataAt(const Features& features)
     {
         return Data[
             features.GeneralizedPlace
-                * 8 // Direction
-                * 8 // NeighborCount
-                * 7 // AffectedDisksCount
-                * 7 // NeighborColorChangeCount
-                * 5 // IslandsCount
-            + features.Direction
                 * 8 // NeighborCount
                 * 7 // AffectedDisksCount
+                * 8 // Direction
                 * 7 // NeighborColorChangeCount
                 * 5 // IslandsCount
             + features.NeighborCount
                 * 7 // AffectedDisksCount
+                * 8 // Direction
                 * 7 // NeighborColorChangeCount
                 * 5 // IslandsCount
             + features.AffectedDisksCount
+                * 8 // Direction
+                * 7 // NeighborColorChangeCount
+                * 5 // IslandsCount
+            + features.Direction
                 * 7 // NeighborColorChangeCount
                 * 5 // IslandsCount
             + features.NeighborColorChangeCount
@@ -592,97 +1293,60 @@ namespace Reversi
 
     float EvolvingAI::GetScore(const Features& features)
     {
+        unsigned short& data = DataAt(features);
         if (Generalization == 0)
-            return ((float)DataAt(features))/255;
-        float specific_score = ((float)DataAt(features))/255;
+            return ((float)evolving_ai_load_cell(data))/EVOLVING_AI_MAX_DATA_VALUE;
+        float specific_score = ((float)evolving_ai_load_cell(data))/EVOLVING_AI_MAX_DATA_VALUE;
         float generalized_score = 0;
-        float generalized_count = 0;
-        Features general_features = features;
-        for (int nccc = 0; nccc < 7; nccc++)
+        // The cells of all the weak feature values are adjacent, NeighborColorChangeCount major
+        int specific_index = features.NeighborColorChangeCount * 5 + features.IslandsCount;
+        unsigned short* general_data = &data - specific_index;
+        for (int i = 0; i < 7 * 5; i++)
         {
-            for (int ic = 0; ic < 5; ic++)
-            {
-                if (features.NeighborColorChangeCount == nccc && features.IslandsCount == ic)
-                    continue;
-                general_features.NeighborColorChangeCount = nccc;
-                general_features.IslandsCount = ic;
-                generalized_score += (((float)DataAt(general_features)) / 255);
-                generalized_count += 1;
-            }
+            if (i == specific_index)
+                continue;
+            generalized_score += (((float)evolving_ai_load_cell(general_data[i])) / EVOLVING_AI_MAX_DATA_VALUE);
         }
-        generalized_score /= generalized_count;
+        generalized_score /= 7 * 5 - 1;
         return (1 - Generalization) * specific_score + Generalization * generalized_score;
     }
 
-    void EvolvingAI::Learn(const Features& features, float feedback)
+    /// @brief The smallest change of a cell by learning, the change of a one byte cell.
+    ///        Most of the feedbacks are too small to change the order of the moves otherwise.
+    constexpr float EVOLVING_AI_MIN_LEARNING_STEP = 257;
+    /// @brief With EvolvingAI::DecayByVisits, the changes of a cell are multiplied by this / (this + the visit count),
+    ///        so the cells of the common features settle instead of following every game.
+    constexpr float EVOLVING_AI_LEARNING_DECAY_VISITS = 256;
+
+    void EvolvingAI::Learn(const Features& features, float feedback, std::vector<int>* changed_cells)
     {
         auto& data = DataAt(features);
-        float value_f = std::clamp((float)data + feedback * 255 * LearningRate, (float)0, (float)255);
-        value_f = feedback < 0 ? std::floor(value_f) : std::ceil(value_f);
-        data = (unsigned char) value_f;
-    }
-
-    std::vector<EvolvingAI::Features> EvolvingAI::GetFeatures(const Logic& state, int x, int y)
-    {
-        std::vector<EvolvingAI::Features> result;
-        for (int dx = -1; dx <= 1; dx++)
-        {
-            for (int dy = -1; dy <= 1; dy++)
-            {
-                if (dx == 0 && dy == 0)
-                    continue;
-                Features features;
-                features.GeneralizedPlace = GetGeneralizedPlace(x, y);
-                features.Direction = GetGeneralizedDirection(x, y, dx, dy);
-                features.NeighborCount = 0;
-                features.AffectedDisksCount = 0;
-                features.NeighborColorChangeCount = 0;
-                features.IslandsCount = 0;
-                int new_x = x + dx;
-                int new_y = y + dy;
-                bool have_passed_none = false;
-                bool have_passed_current_turn = false;
-                Side last_side = Side::None;
-                while (0 <= new_x && new_x < 8 && 0 <= new_y && new_y < 8)
-                {
-                    auto new_side = state.Get(new_x, new_y);
-                    if (!have_passed_none)
-                    {
-                        if (new_side != Side::None)
-                            features.NeighborCount++;
-                        if (!have_passed_current_turn)
-                        {
-                            if (new_side == Side::None)
-                                features.AffectedDisksCount = 0;
-                            else if (new_side != state.GetCurrentTurn())
-                                features.AffectedDisksCount++;
-                            // else: the count is correct
-                        }
-                        if (new_side != Side::None && last_side != Side::None && new_side != last_side)
-                        {
-                            features.NeighborColorChangeCount++;
-                        }
-                    }
-                    if (new_side != Side::None && last_side == Side::None)
-                        features.IslandsCount++;
-
-                    if (new_side == Side::None)
-                        have_passed_none = true;
-                    if (new_side == state.GetCurrentTurn())
-                        have_passed_current_turn = true;
-                    new_x += dx;
-                    new_y += dy;
-                    last_side = new_side;
-                }
-                if (!have_passed_current_turn)
-                    features.AffectedDisksCount = 0;
-                result.push_back(features);
-            }
+        int index = (int)(&data - Data);
+        std::atomic_ref<unsigned short> visits(Visits[index]);
+        unsigned short visits_count = visits.load(std::memory_order_relaxed);
+        while (visits_count < EVOLVING_AI_MAX_VISITS
+            && !visits.compare_exchange_weak(visits_count, (unsigned short)(visits_count + 1), std::memory_order_relaxed));
+        float step = feedback * EVOLVING_AI_MAX_DATA_VALUE * LearningRate;
+        if (feedback != 0 && std::abs(step) < EVOLVING_AI_MIN_LEARNING_STEP)
+            step = feedback < 0 ? -EVOLVING_AI_MIN_LEARNING_STEP : EVOLVING_AI_MIN_LEARNING_STEP;
+        if (DecayByVisits)
+            step *= EVOLVING_AI_LEARNING_DECAY_VISITS / (EVOLVING_AI_LEARNING_DECAY_VISITS + visits_count);
+        // The change is applied to the latest value, so the changes of the other learners aren't lost
+        std::atomic_ref<unsigned short> cell(data);
+        unsigned short value = cell.load(std::memory_order_relaxed);
+        unsigned short new_value;
+        do
+        {
+            float value_f = std::clamp((float)value + step, (float)0, (float)EVOLVING_AI_MAX_DATA_VALUE);
+            value_f = feedback < 0 ? std::floor(value_f) : std::ceil(value_f);
+            new_value = (unsigned short) value_f;
         }
-        return result;
+        while (new_value != value && !cell.compare_exchange_weak(value, new_value, std::memory_order_relaxed));
+        if (changed_cells != nullptr && (new_value != value || visits_count < EVOLVING_AI_MAX_VISITS))
+            changed_cells->push_back(index);
     }
 
-    int EvolvingAI::GetGeneralizedPlace(int x, int y)
+    constexpr int evolving_ai_generalized_place(int x, int y)
     {
         if (x >= 4)
         {
@@ -719,7 +1383,7 @@ namespace Reversi
         }
     }
 
-    int EvolvingAI::GetGeneralizedDirection(int x, int y, int dx, int dy)
+    constexpr int evolving_ai_generalized_direction(int x, int y, int dx, int dy)
     {
         if (x >= 4)
         {
@@ -795,6 +1459,113 @@ namespace Reversi
         }
     }
 
+    /// @brief The slots in a direction from a slot, nearest first, and the generalized direction of it.
+    struct EvolvingAIRay
+    {
+    public:
+        signed char Slots[7];
+        unsigned char Length;
+        unsigned char GeneralizedDirection;
+    };
+
+    /// @brief What the features of a move at a slot need, except the disks.
+    struct EvolvingAISlotRays
+    {
+    public:
+        unsigned char GeneralizedPlace;
+        /// @brief In the order of the directions of EvolvingAI::GetFeatures.
+        EvolvingAIRay Rays[8];
+    };
+
+    constexpr std::array<EvolvingAISlotRays, 64> create_evolving_ai_rays()
+    {
+        std::array<EvolvingAISlotRays, 64> result {};
+        for (int slot = 0; slot < 64; slot++)
+        {
+            int x = slot & 7;
+            int y = slot >> 3;
+            result[slot].GeneralizedPlace = evolving_ai_generalized_place(x, y);
+            int i = 0;
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    if (dx == 0 && dy == 0)
+                        continue;
+                    auto& ray = result[slot].Rays[i++];
+                    ray.GeneralizedDirection = evolving_ai_generalized_direction(x, y, dx, dy);
+                    ray.Length = 0;
+                    for (int new_x = x + dx, new_y = y + dy; 0 <= new_x && new_x < 8 && 0 <= new_y && new_y < 8; new_x += dx, new_y += dy)
+                        ray.Slots[ray.Length++] = new_y << 3 | new_x;
+                }
+            }
+        }
+        return result;
+    }
+
+    constexpr std::array<EvolvingAISlotRays, 64> EVOLVING_AI_RAYS = create_evolving_ai_rays();
+
+    void EvolvingAI::GetFeatures(const BitBoard& board, int slot, Features* features)
+    {
+        const auto& slot_rays = EVOLVING_AI_RAYS[slot];
+        for (int i = 0; i < 8; i++)
+        {
+            const auto& ray = slot_rays.Rays[i];
+            Features& ray_features = features[i];
+            ray_features.GeneralizedPlace = slot_rays.GeneralizedPlace;
+            ray_features.Direction = ray.GeneralizedDirection;
+            ray_features.NeighborCount = 0;
+            ray_features.AffectedDisksCount = 0;
+            ray_features.NeighborColorChangeCount = 0;
+            ray_features.IslandsCount = 0;
+            bool have_passed_none = false;
+            bool have_passed_current_turn = false;
+            // 0: none, 1: the current turn, 2: the other side
+            int last_side = 0;
+            for (int j = 0; j < ray.Length; j++)
+            {
+                int new_side = (int)((board.Player >> ray.Slots[j]) & 1) | (int)((board.Opponent >> ray.Slots[j]) & 1) << 1;
+                if (!have_passed_none)
+                {
+                    if (new_side != 0)
+                        ray_features.NeighborCount++;
+                    if (!have_passed_current_turn)
+                    {
+                        if (new_side == 0)
+                            ray_features.AffectedDisksCount = 0;
+                        else if (new_side == 2)
+                            ray_features.AffectedDisksCount++;
+                        // else: the count is correct
+                    }
+                    if (new_side != 0 && last_side != 0 && new_side != last_side)
+                    {
+                        ray_features.NeighborColorChangeCount++;
+                    }
+                }
+                if (new_side != 0 && last_side == 0)
+                    ray_features.IslandsCount++;
+
+                if (new_side == 0)
+                    have_passed_none = true;
+                if (new_side == 1)
+                    have_passed_current_turn = true;
+                last_side = new_side;
+            }
+            if (!have_passed_current_turn)
+                ray_features.AffectedDisksCount = 0;
+        }
+    }
+
+    int EvolvingAI::GetGeneralizedPlace(int x, int y)
+    {
+        return EVOLVING_AI_RAYS[y << 3 | x].GeneralizedPlace;
+    }
+
+    int EvolvingAI::GetGeneralizedDirection(int x, int y, int dx, int dy)
+    {
+        return evolving_ai_generalized_direction(x, y, dx, dy);
+    }
+
     std::tuple<int, int> EvolvingAI::GetActualDirection(int x, int y, int generalized_direction)
     {
         // dy=+: 3 2 1
@@ -834,4 +1605,272 @@ namespace Reversi
         }
         return std::make_tuple(dx, dy);
     }
+
+    constexpr static int MCTS_AI_MAX_NODES = 1 << 20;
+    constexpr static float MCTS_AI_EXPLORATION = 1.41421356f;
+    /// @brief The reward of a win, in the units of MCTSAI::Node::Rewards.
+    constexpr static int MCTS_AI_WIN_REWARD = 1024;
+    /// @brief The network's predictions are logits of the expected result with the scale that ReversiTuner trains.
+    constexpr static float MCTS_AI_NETWORK_LOGIT_SCALE = 32;
+
+    /// @throws std::invalid_argument If neither limit is set, as a decision would never end.
+    void mcts_ai_check_limits(int playouts, double time_budget)
+    {
+        if (playouts <= 0 && time_budget <= 0)
+            throw std::invalid_argument("MCTSAI needs a number of playouts or a time budget.");
+    }
+
+    MCTSAI::MCTSAI(int Playouts, double TimeBudget, int ThreadsCount, std::shared_ptr<const NetworkWeights> Network)
+        : Playouts(Playouts), TimeBudget(TimeBudget), ThreadsCount(ThreadsCount), Network(Network),
+          Random(std::random_device()()), Nodes(new Node[MCTS_AI_MAX_NODES]), NodesCount(0)
+    {
+        if (this->ThreadsCount <= 0)
+            this->ThreadsCount = ThreadPool::GetShared().GetThreadsCount() + 1;
+        mcts_ai_check_limits(Playouts, TimeBudget);
+    }
+
+    std::optional<std::tuple<int, int>> MCTSAI::Decide(const Logic& state)
+    {
+        if (state.GetCurrentTurn() == Side::None || state.IsGameOver())
+            return std::optional<std::tuple<int, int>>();
+        auto root_board = BitBoard::FromLogic(state, state.GetCurrentTurn());
+        NodesCount = 1;
+        Reset(Nodes[0], -1);
+        Expand(Nodes[0], root_board);
+        if (Nodes[0].ChildrenCount == 0) // Robust code
+            return std::optional<std::tuple<int, int>>();
+
+        std::atomic<int> playouts_count(0);
+        auto deadline = TimeBudget > 0 ?
+            std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(TimeBudget))
+            : std::chrono::steady_clock::time_point::max();
+        TaskGroup tasks;
+        for (int i = 1; i < ThreadsCount; i++)
+        {
+            unsigned int seed = Random();
+            tasks.Run([&, seed]() { RunPlayouts(root_board, playouts_count, deadline, seed); });
+        }
+        RunPlayouts(root_board, playouts_count, deadline, Random());
+        tasks.Wait();
+
+        const Node* best = nullptr;
+        for (int i = 0; i < Nodes[0].ChildrenCount; i++)
+        {
+            const Node& child = Nodes[Nodes[0].FirstChild + i];
+            if (best == nullptr || child.Visits > best->Visits)
+                best = &child;
+        }
+#if REVERSI_DEBUG
+        Log("MCTS AI: " + std::to_string(playouts_count.load()) + " playouts, " + std::to_string(NodesCount.load()) + " nodes");
+#endif
+        return std::make_tuple(best->Move & 7, best->Move >> 3);
+    }
+
+    int MCTSAI::GetPlayouts()
+    {
+        return Playouts;
+    }
+
+    void MCTSAI::SetPlayouts(int value)
+    {
+        mcts_ai_check_limits(value, TimeBudget);
+        Playouts = value;
+    }
+
+    double MCTSAI::GetTimeBudget()
+    {
+        return TimeBudget;
+    }
+
+    void MCTSAI::SetTimeBudget(double value)
+    {
+        mcts_ai_check_limits(Playouts, value);
+        TimeBudget = value;
+    }
+
+    void MCTSAI::SetSeed(unsigned int seed)
+    {
+        Random.seed(seed);
+    }
+
+    void MCTSAI::Reset(Node& node, int move)
+    {
+        node.Rewards.store(0, std::memory_order_relaxed);
+        node.Visits.store(0, std::memory_order_relaxed);
+        node.VirtualLosses.store(0, std::memory_order_relaxed);
+        node.Expansion.store(0, std::memory_order_relaxed);
+        node.Move = move;
+        node.ChildrenCount = 0;
+        node.FirstChild = -1;
+    }
+
+    bool MCTSAI::Expand(Node& node, const BitBoard& board)
+    {
+        char expansion = node.Expansion.load(std::memory_order_acquire);
+        if (expansion == 2)
+            return true;
+        if (expansion != 0 || !node.Expansion.compare_exchange_strong(expansion, 1, std::memory_order_acquire))
+            return false; // Another thread is expanding it, or it can't be expanded
+        unsigned long long moves = board.GetMoves();
+        int count = std::popcount(moves);
+        // Reserved only if the children fit, so that NodesCount never passes the arena
+        int first_child = NodesCount.load(std::memory_order_relaxed);
+        do
+        {
+            if (first_child + count > MCTS_AI_MAX_NODES)
+            {
+                // The arena is full, the node stays a leaf for the rest of the decision
+                node.Expansion.store(3, std::memory_order_release);
+                return false;
+            }
+        }
+        while (!NodesCount.compare_exchange_weak(first_child, first_child + count, std::memory_order_relaxed));
+        for (int i = 0; moves != 0; i++)
+        {
+            Reset(Nodes[first_child + i], std::countr_zero(moves));
+            moves &= moves - 1;
+        }
+        node.FirstChild = first_child;
+        node.ChildrenCount = count;
+        node.Expansion.store(2, std::memory_order_release);
+        return true;
+    }
+
+    /// @return The reward of the game over board for BitBoard::Player.
+    int mcts_ai_game_over_reward(const BitBoard& board)
+    {
+        int difference = board.GetPlayerCount() - board.GetOpponentCount();
+        return difference > 0 ? MCTS_AI_WIN_REWARD : (difference == 0 ? MCTS_AI_WIN_REWARD / 2 : 0);
+    }
+
+    /// @brief Plays random moves until the game is over.
+    /// @param player_is_root_side Whether the side to move in the board is the side to move at the root.
+    /// @return The reward for the side to move at the root.
+    int mcts_ai_random_playout(BitBoard board, bool player_is_root_side, std::mt19937& random)
+    {
+        while (true)
+        {
+            unsigned long long moves = board.GetMoves();
+            if (moves == 0)
+            {
+                board.Pass();
+                player_is_root_side = !player_is_root_side;
+                moves = board.GetMoves();
+                if (moves == 0)
+                    break;
+            }
+            int choice = std::uniform_int_distribution<int>(0, std::popcount(moves) - 1)(random);
+            for (int i = 0; i < choice; i++)
+                moves &= moves - 1;
+            int index = std::countr_zero(moves);
+            board.MakeMove(index, board.GetFlips(index));
+            player_is_root_side = !player_is_root_side;
+        }
+        int reward = mcts_ai_game_over_reward(board);
+        return player_is_root_side ? reward : MCTS_AI_WIN_REWARD - reward;
+    }
+
+    /// @brief Evaluates the replies of the board in one batch and scores the board by the best one.
+    /// @param board The side to move can move, or the game is over.
+    /// @param player_is_root_side Whether the side to move in the board is the side to move at the root.
+    /// @return The reward for the side to move at the root.
+    int mcts_ai_network_evaluation(const NetworkWeights& network, const BitBoard& board, bool player_is_root_side)
+    {
+        unsigned long long moves = board.GetMoves();
+        int reward;
+        if (moves == 0)
+        {
+            reward = mcts_ai_game_over_reward(board);
+        }
+        else
+        {
+            BitBoard replies[64];
+            int count = 0;
+            for (; moves != 0; moves &= moves - 1)
+            {
+                int index = std::countr_zero(moves);
+                replies[count] = board;
+                replies[count++].MakeMove(index, board.GetFlips(index));
+            }
+            float predictions[64];
+            network.PredictBatch(replies, count, predictions);
+            // The predictions are for the opponent
+            float best = -*std::min_element(predictions, predictions + count);
+            reward = (int)(MCTS_AI_WIN_REWARD / (1 + std::exp(-best / MCTS_AI_NETWORK_LOGIT_SCALE)));
+        }
+        return player_is_root_side ? reward : MCTS_AI_WIN_REWARD - reward;
+    }
+
+    void MCTSAI::RunPlayouts(const BitBoard& root, std::atomic<int>& playouts_count,
+        std::chrono::steady_clock::time_point deadline, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        /// @brief (Node, whether the side that made its move is the root side) for each node of the playout.
+        std::tuple<Node*, bool> path[64];
+        while ((Playouts <= 0 || playouts_count.fetch_add(1, std::memory_order_relaxed) < Playouts)
+            && (TimeBudget <= 0 || std::chrono::steady_clock::now() < deadline))
+        {
+            // Selection, with virtual losses on the way
+            BitBoard board = root;
+            bool player_is_root_side = true;
+            Node* node = &Nodes[0];
+            int path_length = 0;
+            node->VirtualLosses.fetch_add(1, std::memory_order_relaxed);
+            while (true)
+            {
+                bool expanded = node->Expansion.load(std::memory_order_acquire) == 2;
+                if (!expanded && node->Visits.load(std::memory_order_relaxed) > 0)
+                    expanded = Expand(*node, board); // Expanded on the second visit
+                if (!expanded || node->ChildrenCount == 0)
+                    break;
+                int parent_visits = node->Visits.load(std::memory_order_relaxed) + node->VirtualLosses.load(std::memory_order_relaxed);
+                float log_parent_visits = std::log((float)std::max(1, parent_visits));
+                Node* best = &Nodes[node->FirstChild];
+                float best_value = -1; // The values are not negative
+                for (int i = 0; i < node->ChildrenCount; i++)
+                {
+                    Node* child = &Nodes[node->FirstChild + i];
+                    int visits = child->Visits.load(std::memory_order_relaxed) + child->VirtualLosses.load(std::memory_order_relaxed);
+                    if (visits == 0)
+                    {
+                        best = child;
+                        break;
+                    }
+                    float value = (float)child->Rewards.load(std::memory_order_relaxed) / ((float)MCTS_AI_WIN_REWARD * visits)
+                        + MCTS_AI_EXPLORATION * std::sqrt(log_parent_visits / visits);
+                    if (value > best_value)
+                    {
+                        best = child;
+                        best_value = value;
+                    }
+                }
+                best->VirtualLosses.fetch_add(1, std::memory_order_relaxed);
+                path[path_length++] = std::make_tuple(best, player_is_root_side);
+                board.MakeMove(best->Move, board.GetFlips(best->Move));
+                player_is_root_side = !player_is_root_side;
+                if (board.GetMoves() == 0)
+                {
+                    // Pass, as Logic does. If the other side can't move either, the game is over and the node has no children.
+                    board.Pass();
+                    player_is_root_side = !player_is_root_side;
+                }
+                node = best;
+            }
+
+            // Simulation
+            int result = Network != nullptr ? mcts_ai_network_evaluation(*Network, board, player_is_root_side)
+                : mcts_ai_random_playout(board, player_is_root_side, random);
+
+            // Backpropagation
+            for (int i = 0; i < path_length; i++)
+            {
+                auto [path_node, moved_by_root_side] = path[i];
+                path_node->Rewards.fetch_add(moved_by_root_side ? result : MCTS_AI_WIN_REWARD - result, std::memory_order_relaxed);
+                path_node->Visits.fetch_add(1, std::memory_order_relaxed);
+                path_node->VirtualLosses.fetch_sub(1, std::memory_order_relaxed);
+            }
+            Nodes[0].Visits.fetch_add(1, std::memory_order_relaxed);
+            Nodes[0].VirtualLosses.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
 }
@@ -3,10 +3,25 @@
 #include "Reversi.dec.h"
 
 #include "Logic.h"
+#include "MappedFile.h"
+#include "NetworkEvaluator.h"
+#include "PatternEvaluator.h"
+#include "SearchEngine.h"
+#include "ThreadPool.h"
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <random>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
 namespace Reversi
@@ -17,34 +32,146 @@ namespace Reversi
         virtual ~AI() = default;
         virtual std::optional<std::tuple<int, int>> Decide(const Logic& state) = 0;
         virtual void Learn(const Logic& game_over_state);
+        /// @brief Learns from the game like Learn, without waiting for it, the queued games are learned in order.
+        ///        The default learns immediately.
+        virtual void QueueLearning(const Logic& game_over_state);
+        /// @brief Blocks until the games queued by QueueLearning are learned.
+        virtual void WaitForLearning();
+        /// @brief Called after each move of a game that may be learned,
+        ///        so that the AI can prepare the learning while the game is played.
+        virtual void ObserveMove(const Logic& state);
+        /// @brief Called while the other player is to move in the given state,
+        ///        so that the AI can think in the background until the next Decide call.
+        virtual void Ponder(const Logic& state);
+        /// @brief Stops the background thinking started by Ponder, if any. Blocks until it is stopped.
+        virtual void StopPondering();
+        /// @brief Seeds the random choices of the AI, so that its decisions can be reproduced.
+        ///        The default seed is random.
+        virtual void SetSeed(unsigned int seed);
     };
 
+    /// @brief Orders the moves by the scores that an EvolvingAI has learned, or keeps them if there's no EvolvingAI.
+    struct EvolvingAIMoveOrderer final
+    {
+    public:
+        /// @brief Can learn while a search is using it, but the order of the moves then changes during the search.
+        EvolvingAI* Scorer;
+
+        inline void Order(const Logic& state, std::tuple<int, int>* moves, int count) const;
+    };
+
+    /// @brief Plays with the search engine, see SearchEngine for the search.
     class DecisionTreeAI : public AI
     {
     public:
-        DecisionTreeAI(int depth);
+        /// @brief An engine for each evaluator, so that the evaluator is chosen once rather than at each leaf.
+        using Engine = std::variant<
+            SearchEngine<NetworkEvaluator, EvolvingAIMoveOrderer>,
+            SearchEngine<PatternEvaluator, EvolvingAIMoveOrderer>,
+            SearchEngine<DiscRatioEvaluator, EvolvingAIMoveOrderer>>;
+        using Bound = SearchEngineTypes::Bound;
+        using MoveAnalysis = SearchEngineTypes::MoveAnalysis;
+        using SearchStatistics = SearchEngineTypes::SearchStatistics;
+        static constexpr int DISC_SCORE = SearchEngineTypes::DISC_SCORE;
+
+        /// @param move_ordering_ai Orders the moves of the inner nodes by its learned scores if not null,
+        ///                         which makes the cutoffs earlier as it learns. It shouldn't learn while searching.
+        /// @param weights Evaluates the positions by the tuned pattern weights if not null, otherwise by the discs ratio.
+        /// @param network Evaluates the positions by the network if not null, instead of weights.
+        DecisionTreeAI(int depth, std::shared_ptr<EvolvingAI> move_ordering_ai = nullptr,
+            std::shared_ptr<const PatternWeights> weights = nullptr, std::shared_ptr<const NetworkWeights> network = nullptr);
         virtual std::optional<std::tuple<int, int>> Decide(const Logic& state) override;
+        virtual void Ponder(const Logic& state) override;
+        virtual void StopPondering() override;
+        /// @brief See SearchEngine::Analyze.
+        std::vector<MoveAnalysis> Analyze(const Logic& state, int count = 0);
+        SearchStatistics GetLastSearchStatistics();
+        void SetLogStatistics(bool);
         int GetDepth();
         void SetDepth(int);
+        long long GetNodeBudget();
+        /// @brief See SearchEngine::SetNodeBudget.
+        void SetNodeBudget(long long);
     private:
-        int Depth;
+        std::shared_ptr<EvolvingAI> MoveOrderingAI;
+        Engine Searcher;
 
-        float CalculateScore(const Logic& state, Side side, int depth, float alpha, float beta);
-        float CalculateScoreTerminal(const Logic& state, Side side);
+        /// @return The engine of the network if not null, otherwise of the weights if not null, otherwise of the discs ratio.
+        static Engine CreateEngine(int depth, EvolvingAI* move_ordering_ai,
+            std::shared_ptr<const PatternWeights> weights, std::shared_ptr<const NetworkWeights> network);
     };
 
     class EvolvingAI : public AI
     {
     public:
+        /// @brief The number of cells of the learned data, a 16-bit fixed-point value and a visit count each.
+        static constexpr int DATA_SIZE =
+            10  // GeneralizedPlace
+            * 8 // NeighborCount
+            * 7 // AffectedDisksCount
+            * 8 // Direction
+            * 7 // NeighborColorChangeCount
+            * 5 // IslandsCount
+            ;
+
+        /// @brief How the data file is kept up to date.
+        enum class Storage : char
+        {
+            /// @brief The data is read into memory, and the whole file is rewritten after each learned game.
+            Rewrite = 0,
+            /// @brief The data is the file mapped into memory, learning changes the file in place.
+            Mapped = 1,
+            /// @brief The changes of each learned game are appended to a journal next to the data file,
+            ///        which is compacted into the data file in the background when it grows large.
+            Journal = 2,
+            /// @brief Like Storage::Mapped, and all the processes on the machine that use the data file with Storage::Shared
+            ///        learn into and read the same mapped cells, so none of their learned games are lost.
+            ///        A small file next to the data file tells the processes when the others have learned.
+            ///
+            /// While a process has the data file mapped, the processes with the other storages write the cells they learn
+            /// into it in place instead of replacing it, so they don't lose the learning of the mapped processes either,
+            /// except where they learn the same cells, which keep the last value written.
+            /// They don't see the learning of the others until they're loaded again.
+            Shared = 3
+        };
+
         /// @param LearningRate In range [0, 1].
         ///                     0: no learning, 1: immediately thinking the last game is everything and ignoring similar history.
         /// @param Generalization How much generalization is done on weak features, in range [0,1].
         ///                       0: no generalization,
         ///                       0.5: specific and generalization scores equally contribute to the score,
         ///                       1: complete generalization.
-        EvolvingAI(std::string DataFilePath, float LearningRate = 0.1, float Generalization = 0.1);
+        /// @param FlushInterval With Storage::Mapped or Storage::Shared, the number of learned games between the requests
+        ///                      to write the changed pages to the file, 0 to leave it to the operating system.
+        /// @param DecayByVisits Whether the changes of a cell by learning get smaller as the cell is learned more times,
+        ///                      so that it settles instead of following every game.
+        ///                      The visit counts are kept in the data file either way.
+        /// @throws std::runtime_error If the shared file can't be locked, or the data file needs to be migrated while
+        ///                            other processes have it mapped.
+        ///                            With Storage::Mapped or Storage::Shared, if the data file can't be mapped.
+        ///                            With Storage::Shared, if the shared file can't be mapped.
+        EvolvingAI(std::string DataFilePath, float LearningRate = 0.1, float Generalization = 0.1,
+            Storage DataStorage = Storage::Rewrite, int FlushInterval = 1, bool DecayByVisits = true);
         virtual std::optional<std::tuple<int, int>> Decide(const Logic& state) override;
+        /// @brief Learns from the game. Can be called by several threads, while others call Decide and the scores,
+        ///        which see the data of whole learned games only.
         virtual void Learn(const Logic& game_over_state) override;
+        /// @brief Learns and saves the queued games in order on a background task of the shared thread pool.
+        ///        Decide only waits for it while a learned game is applied to the data.
+        virtual void QueueLearning(const Logic& game_over_state) override;
+        virtual void WaitForLearning() override;
+        /// @brief Records the features and the impacts of the moves of the game as they're made,
+        ///        so that learning the game only applies the feedback of the result.
+        ///        Each thread records its own game, so several threads can play games at once.
+        ///        The games learned without observing their moves are recorded when they're learned.
+        virtual void ObserveMove(const Logic& state) override;
+        virtual void SetSeed(unsigned int seed) override;
+        /// @brief The learned desirability of a legal move for the side to move, the higher the better.
+        ///        Cached per thread, so repeated calls are cheap.
+        float GetMoveScore(const Logic& state, int x, int y);
+        /// @brief GetMoveScore of each of the legal moves, sharing the work of reading the board.
+        /// @param scores Filled with count scores.
+        void GetMoveScores(const Logic& state, const std::tuple<int, int>* moves, int count, float* scores);
     private:
 
         class Features // TODO: Decide on adding the number of moves done in range [0,59].
@@ -66,37 +193,310 @@ namespace Reversi
             int IslandsCount;
         };
 
+        /// @brief The features and the impacts of the moves of a game, which are known before the result.
+        ///
+        /// The impacts are kept in flat arrays, indexed by slot, move index and direction,
+        /// as a game has at most 60 moves, and each move has an impact for each of its 8 directions on each slot.
+        class GameRecord final
+        {
+        public:
+            static constexpr int MAX_MOVES_COUNT = 60;
+
+            /// @brief The state after the recorded moves.
+            Logic State;
+            int MovesCount;
+            /// @brief Slot -> Move index -> Direction -> Impact factor, 0 if there's no impact.
+            float Impacts[64 * MAX_MOVES_COUNT * 8];
+            /// @brief Move index -> The slot index of the move.
+            int MoveSlots[MAX_MOVES_COUNT];
+            /// @brief Move index -> The side that made the move.
+            Side MoveSides[MAX_MOVES_COUNT];
+            /// @brief Move index -> Bit for each direction whose impact on the slot of the move is still the initial one.
+            ///
+            /// The initial impact is shared by the directions, so reducing it for one of them reduces it for all of them,
+            /// and it's reduced once for each direction that shares it.
+            unsigned char SharedImpactDirections[MAX_MOVES_COUNT];
+            /// @brief Move index -> Features for each direction, from the state before the move.
+            Features MoveFeatures[MAX_MOVES_COUNT * 8];
+
+            GameRecord();
+            /// @brief Forgets the recorded moves, clearing only the impacts that they have set.
+            void Reset();
+            /// @return Whether the recorded moves are the moves of the state.
+            bool IsOf(const Logic& state) const;
+            /// @brief Records the last move of the state if the others are recorded,
+            ///        otherwise records all of its moves again, as after an undo or in a new game.
+            /// @throws std::logic_error If the history of the state is wrong.
+            void Update(const Logic& state);
+            float& ImpactAt(int slot, int move_index, int direction);
+        private:
+            /// @brief Adds impact, replacing if there's an old impact in place with lower factor.
+            void AddImpact(int move_index, int direction, int slot, float factor);
+            void AddMove(const Logic::Move& move);
+        };
+
+        /// @brief The game that ObserveMove records on a thread.
+        struct CurrentGame
+        {
+        public:
+            std::unique_ptr<GameRecord> Record;
+            /// @brief ObservationsCount when the last move of the game was observed.
+            unsigned long long LastObservation;
+            /// @brief Whether the thread is recording a move, so that the record isn't pruned meanwhile.
+            bool IsUpdating;
+        };
+
+        /// @brief A game to learn by LearningTask.
+        struct QueuedGame
+        {
+        public:
+            Logic GameOverState;
+            /// @brief Null if the moves of the game weren't observed.
+            std::unique_ptr<GameRecord> Record;
+        };
+
         float LearningRate;
         float Generalization;
         std::string DataFilePath;
-        unsigned char Data[
-            10  // GeneralizedPlace
-            * 8 // Direction
-            * 8 // NeighborCount
-            * 7 // AffectedDisksCount
-            * 7 // NeighborColorChangeCount
-            * 5 // IslandsCount
-        ];
+        Storage DataStorage;
+        int FlushInterval;
+        bool DecayByVisits;
+        /// @brief The learned games since the last flush of DataMapping.
+        int UnflushedGamesCount;
+        std::string JournalFilePath;
+        /// @brief Locked shared by the processes that have the data file mapped, and exclusively while a process replaces
+        ///        the data file, with any storage. Holds SharedGeneration.
+        std::string SharedFilePath;
+        /// @brief Locked exclusively while a learned game is applied to Data, so that the readers see whole games,
+        ///        and shared by them.
+        std::shared_mutex DataMutex;
+        /// @brief Serializes the saves of the learned games, so that the journal records are whole.
+        std::mutex SaveMutex;
+        /// @brief Guards the journal file, JournalSize and IsCompacting against the compaction task.
+        std::mutex JournalMutex;
+        /// @brief The size of the journal file in bytes.
+        long long JournalSize;
+        bool IsCompacting;
+        /// @brief The cells in the journal since the last compaction, which it writes in place
+        ///        if it can't replace the data file.
+        std::vector<int> UncompactedCells;
+        std::mutex LearningQueueMutex;
+        /// @brief The games to learn by LearningTask, in order.
+        std::deque<QueuedGame> LearningQueue;
+        /// @brief Guards CurrentGames, ObservationsCount and FreeGameRecords.
+        std::mutex CurrentGamesMutex;
+        /// @brief Thread -> The game observed by ObserveMove on the thread, removed when it's learned or abandoned.
+        std::unordered_map<std::thread::id, CurrentGame> CurrentGames;
+        /// @brief The moves observed by ObserveMove on all the threads.
+        unsigned long long ObservationsCount;
+        /// @brief The records of the learned and the abandoned games, for reuse, as a record is large.
+        std::vector<std::unique_ptr<GameRecord>> FreeGameRecords;
+        /// @brief Whether LearningTask is learning the queue, so that it's not run twice.
+        bool IsLearningQueue;
+        /// @brief Mixed into the score cache keys, changed whenever Data changes,
+        ///        so that the thread-local score cache never returns scores of other instances or old data.
+        std::atomic<unsigned long long> ScoreCacheSalt;
+        std::mutex RandomMutex;
+        /// @brief Breaks the ties between the best moves.
+        std::mt19937 Random;
+        /// @brief The memory of Data and Visits with Storage::Rewrite, and before the file is mapped with Storage::Mapped.
+        std::unique_ptr<unsigned short[]> DataBuffer;
+        /// @brief A shared lock of SharedFilePath while DataMapping is mapped, so that the others don't replace the data file.
+        std::unique_ptr<FileLock> SharedLock;
+        /// @brief The data file with Storage::Mapped or Storage::Shared.
+        std::unique_ptr<MappedFile> DataMapping;
+        /// @brief The shared file with Storage::Shared.
+        std::unique_ptr<MappedFile> SharedMapping;
+        /// @brief The number of the games learned by all the processes, in SharedMapping, otherwise null.
+        ///        Mixed into the score cache keys, so that the scores of the data before the learning of the other
+        ///        processes aren't returned.
+        unsigned long long* SharedGeneration;
+        /// @brief DATA_SIZE cells, in DataBuffer or DataMapping, 0 to 65535 for the scores 0 to 1.
+        ///
+        /// Decide and the scores read the cells under a shared lock of DataMutex, and each learned game is applied
+        /// under an exclusive lock. The cells are also read and changed as relaxed atomics after loading,
+        /// as with Storage::Shared the other processes change them without the lock,
+        /// so their readers may see a game of another process partly applied.
+        /// The directions are inside the strong features and outside the weak features,
+        /// so that the directions of a move with the same strong features are in adjacent cache lines,
+        /// and the weak features of a direction, which generalization reads together, are contiguous.
+        unsigned short* Data;
+        /// @brief Cell -> The number of times it was learned, saturated at 65535. After Data.
+        ///
+        /// Only learning reads them, so they're apart from Data to keep the cells that Decide reads dense.
+        unsigned short* Visits;
 
         void ResetData();
-        void RenameToBackup(bool unsupported_file);
+        void InvalidateScoreCache();
+        unsigned long long GetScoreCacheSalt();
+        /// @return A path next to the file that no file has, for a backup of the file.
+        std::string GetBackupPath(const std::string& path, bool unsupported_file);
+        void RenameToBackup(const std::string& path, bool unsupported_file);
+        /// @return Whether the data file is a supported file of the current version, which can be mapped.
+        bool IsCurrentFile();
+        /// @brief Locks SharedFilePath for changing the data file.
+        /// @param lock Set to an exclusive lock if no process has the data file mapped, otherwise to a shared lock.
+        /// @return Whether the lock is exclusive, so that the data file can be replaced,
+        ///         otherwise only the cells of a current data file can be written in place.
+        bool LockDataFile(std::optional<FileLock>& lock);
         void Load();
-        void Save();
-        unsigned char& DataAt(const Features&);
+        /// @brief With Storage::Mapped or Storage::Shared, maps the data file if it's a current file,
+        ///        holding SharedLock, and applies the journal to it.
+        /// @return Whether it's mapped, otherwise it needs to be created or migrated first.
+        bool MapCurrentFile();
+        /// @brief Reads the data file into DataBuffer, resetting the data or migrating it as needed.
+        ///        A reset data file is replaced at once, the old file of a migrated one is kept for the caller to replace.
+        /// @return Whether the data file has the data, false if it's migrated.
+        bool ReadFile();
+        /// @brief Maps the data file, which should be a current file, and uses it as Data.
+        void MapFile();
+        /// @brief Maps the shared file, which SharedLock has created, resizing it if needed.
+        void MapSharedFile();
+        /// @brief Applies the journal to the data, if there's a journal of the current version or of version 2.
+        ///        The partly written record that a crash can leave at the end is removed.
+        /// @param is_current_journal Set to whether the journal is of the current version and can be appended to.
+        /// @param cells Set to the cells that the journal changes.
+        /// @return Whether there was a journal.
+        bool ReplayJournal(bool& is_current_journal, std::vector<int>& cells);
+        /// @brief Creates the journal if it doesn't exist, for appending to it.
+        void OpenJournal();
+        /// @brief Replaces the data file by the data, and removes the journal, which the data includes.
+        ///        The lock of LockDataFile should be held.
+        /// @param cells Null to replace the data file, otherwise only these cells are written into it in place,
+        ///              as LockDataFile couldn't lock it exclusively.
+        void Save(const std::vector<int>* cells = nullptr);
+        /// @brief Makes the changes of the last learned game persistent, as DataStorage does it.
+        /// @param changed_cells The cells changed by the game, with Storage::Rewrite or Storage::Journal.
+        void SaveLearned(std::vector<int>& changed_cells);
+        void AppendJournal(std::vector<int>& changed_cells);
+        /// @return A copy of the data of whole learned games, for saving it while learners are changing it.
+        std::vector<unsigned short> CopyData();
+        /// @brief Replaces the data file by the data, or writes the cells in the compacted journal into it in place
+        ///        if other processes have it mapped, and removes the first compacted_journal_size bytes
+        ///        of the journal, which the data includes. Run by CompactionTask.
+        void Compact(const std::vector<unsigned short>& data, const std::vector<int>& cells, long long compacted_journal_size);
+        /// @brief Learns the queued games until the queue is empty. Run by LearningTask.
+        void LearnQueue();
+        /// @return The record of the observed moves if it is of the game, otherwise null.
+        std::unique_ptr<GameRecord> TakeGameRecord(const Logic& game_over_state);
+        /// @return A reset record, a free one if there is one.
+        std::unique_ptr<GameRecord> AcquireGameRecord();
+        /// @brief Keeps the record for reuse, unless there are enough free records.
+        void ReleaseGameRecord(std::unique_ptr<GameRecord> record);
+        /// @brief Frees the records of the games that aren't observed anymore, like those of the threads that are done.
+        ///        CurrentGamesMutex should be locked.
+        void PruneCurrentGames();
+        /// @param record Null to record the moves of the game now. Released when it's learned.
+        void LearnGame(const Logic& game_over_state, std::unique_ptr<GameRecord> record);
+        unsigned short& DataAt(const Features&);
         /// @return In range [0, 1].
         float GetScore(const Features&);
         /// @param feedback In range [-1, 1].
-        void Learn(const Features&, float feedback);
-        /// @return 8 objects of Features type for each direction.
-        std::vector<Features> GetFeatures(const Logic& state, int x, int y);
+        /// @param changed_cells The index of the cell is added if it or its visit count is changed and this is not null.
+        void Learn(const Features&, float feedback, std::vector<int>* changed_cells);
+        /// @brief GetMoveScore without the cache.
+        /// @param board From the point of view of the side to move.
+        float CalculateMoveScore(const BitBoard& board, int slot);
+        /// @brief GetMoveScore by the hash of the state and the board of it.
+        float GetMoveScore(const BitBoard& board, unsigned long long state_hash, int slot);
+        /// @param board From the point of view of the side to move.
+        /// @param features Filled with 8 objects of Features type, one for each direction.
+        static void GetFeatures(const BitBoard& board, int slot, Features* features);
         /// @brief Gets the generalized place in range [0, 9].
         int GetGeneralizedPlace(int x, int y);
         /// @brief Converts the direction to the direction for generalized place.
         /// @param dx The x direction. Both dx and dy can't be 0 at the same time.
         /// @param dy The y direction. Both dx and dy can't be 0 at the same time.
-        int GetGeneralizedDirection(int x, int y, int dx, int dy);
+        static int GetGeneralizedDirection(int x, int y, int dx, int dy);
         /// @brief Converts the generalized direction to the actual direction on the board.
         /// @return (dx, dy) tuple, both dx and dy are in [-1, 1].
         std::tuple<int, int> GetActualDirection(int x, int y, int generalized_direction);
+
+        /// @brief The last members, so that they wait for the learning and the compaction
+        ///        before the other members are destroyed. The learning is waited first, as it runs compactions.
+        TaskGroup CompactionTask;
+        TaskGroup LearningTask;
+    };
+
+    class MCTSAI : public AI
+    {
+    public:
+        /// @param Playouts The number of playouts per decision, 0 for no limit.
+        /// @param TimeBudget The thinking time per decision in seconds, 0 for no limit.
+        ///                   At least one of Playouts and TimeBudget should be set.
+        /// @param ThreadsCount The number of threads that share the tree, the calling thread and ThreadPool workers,
+        ///                    0 for all the workers of the shared pool.
+        /// @param Network Scores the leaves by the network's evaluation of their best reply if not null,
+        ///                instead of random playouts to the end of the game.
+        /// @throws std::invalid_argument If neither Playouts nor TimeBudget is set, as Decide would never return.
+        MCTSAI(int Playouts, double TimeBudget = 0, int ThreadsCount = 0, std::shared_ptr<const NetworkWeights> Network = nullptr);
+        virtual std::optional<std::tuple<int, int>> Decide(const Logic& state) override;
+        int GetPlayouts();
+        /// @throws std::invalid_argument If neither the playouts nor the time budget would be set.
+        void SetPlayouts(int);
+        double GetTimeBudget();
+        /// @throws std::invalid_argument If neither the playouts nor the time budget would be set.
+        void SetTimeBudget(double);
+        /// @brief The playouts are reproducible with a single thread and no time budget.
+        virtual void SetSeed(unsigned int seed) override;
+    private:
+        /// @brief A tree node, its children are stored next to each other in the arena.
+        struct Node
+        {
+        public:
+            /// @brief The playout results from the point of view of the side that made Move,
+            ///        MCTS_AI_WIN_REWARD per win, half of it per draw and a share of it by the network's evaluation.
+            std::atomic<long long> Rewards;
+            std::atomic<int> Visits;
+            /// @brief The playouts that are passing through the node, counted as losses until they are done,
+            ///        so that the other threads explore other nodes meanwhile.
+            std::atomic<int> VirtualLosses;
+            /// @brief 0: not expanded, 1: being expanded, 2: expanded, 3: a leaf, as the arena was full.
+            std::atomic<char> Expansion;
+            /// @brief The slot index of the move that leads to the node.
+            signed char Move;
+            unsigned char ChildrenCount;
+            /// @brief The arena index of the first child.
+            int FirstChild;
+        };
+
+        int Playouts;
+        double TimeBudget;
+        int ThreadsCount;
+        std::shared_ptr<const NetworkWeights> Network;
+        /// @brief Seeds the playout threads.
+        std::mt19937 Random;
+        std::unique_ptr<Node[]> Nodes;
+        std::atomic<int> NodesCount;
+
+        void Reset(Node&, int move);
+        /// @brief Adds the children of the node if no other thread is doing it.
+        /// @return Whether the node is expanded.
+        bool Expand(Node&, const BitBoard&);
+        /// @brief Runs playouts from the root until the budget is used.
+        void RunPlayouts(const BitBoard& root, std::atomic<int>& playouts_count,
+            std::chrono::steady_clock::time_point deadline, unsigned int seed);
     };
+
+    inline void EvolvingAIMoveOrderer::Order(const Logic& state, std::tuple<int, int>* moves, int count) const
+    {
+        if (Scorer == nullptr)
+            return;
+        float scores[64];
+        Scorer->GetMoveScores(state, moves, count, scores);
+        // Insertion sort, best first, there are few moves
+        for (int i = 1; i < count; i++)
+        {
+            float score = scores[i];
+            auto move = moves[i];
+            int j = i;
+            for (; j > 0 && scores[j - 1] < score; j--)
+            {
+                scores[j] = scores[j - 1];
+                moves[j] = moves[j - 1];
+            }
+            scores[j] = score;
+            moves[j] = move;
+        }
+    }
 }
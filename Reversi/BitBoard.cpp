@@ -0,0 +1,25 @@
+#include "BitBoard.h"
+
+#include "Logic.h"
+
+namespace Reversi
+{
+    BitBoard BitBoard::FromLogic(const Logic& state, Side player)
+    {
+        BitBoard result { 0, 0 };
+        for (int y = 0; y < 8; y++)
+        {
+            for (int x = 0; x < 8; x++)
+            {
+                Side side = state.Get(x, y);
+                if (side == Side::None)
+                    continue;
+                if (side == player)
+                    result.Player |= 1ULL << (y << 3 | x);
+                else
+                    result.Opponent |= 1ULL << (y << 3 | x);
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include <bit>
+
+namespace Reversi
+{
+    /// @brief Compact board state for fast searching, one bit for each slot.
+    ///
+    /// The bit index of a slot is y << 3 | x, the same as the slot index of Logic.
+    /// The hot functions are inline so that they can be fully inlined into search loops.
+    struct BitBoard final
+    {
+    public:
+        /// @brief The disks of the side to move.
+        unsigned long long Player;
+        /// @brief The disks of the other side.
+        unsigned long long Opponent;
+
+        /// @param player The side to consider as the side to move.
+        static BitBoard FromLogic(const Logic&, Side player);
+
+        /// @return A bit for each legal move of the side to move.
+        inline unsigned long long GetMoves() const;
+        /// @return The disks that the move at the slot index flips, 0 if it's not a legal move.
+        inline unsigned long long GetFlips(int index) const;
+        /// @brief Places a disk at the slot index, flips the disks and passes the turn to the other side.
+        inline void MakeMove(int index, unsigned long long flips);
+        /// @brief Passes the turn to the other side without a move.
+        inline void Pass();
+        inline int GetPlayerCount() const;
+        inline int GetOpponentCount() const;
+        /// @brief A well mixed hash of the disks, from the side to move's point of view.
+        inline unsigned long long GetHash() const;
+    private:
+        /// @brief Shifts the bits one slot in the direction, dropping the ones that leave the board.
+        /// @tparam direction In range [0, 7], counter-clockwise from +x.
+        template <int direction>
+        static inline unsigned long long Shift(unsigned long long bits);
+        template <int direction>
+        inline unsigned long long GetMovesInDirection(unsigned long long empty) const;
+        template <int direction>
+        inline unsigned long long GetFlipsInDirection(unsigned long long move) const;
+    };
+
+    constexpr unsigned long long BITBOARD_WITHOUT_X0 = 0xFEFEFEFEFEFEFEFEULL;
+    constexpr unsigned long long BITBOARD_WITHOUT_X7 = 0x7F7F7F7F7F7F7F7FULL;
+
+    template <int direction>
+    inline unsigned long long BitBoard::Shift(unsigned long long bits)
+    {
+        // 3 2 1
+        // 4   0
+        // 5 6 7
+        if constexpr (direction == 0) return (bits << 1) & BITBOARD_WITHOUT_X0;
+        if constexpr (direction == 1) return (bits << 9) & BITBOARD_WITHOUT_X0;
+        if constexpr (direction == 2) return bits << 8;
+        if constexpr (direction == 3) return (bits << 7) & BITBOARD_WITHOUT_X7;
+        if constexpr (direction == 4) return (bits >> 1) & BITBOARD_WITHOUT_X7;
+        if constexpr (direction == 5) return (bits >> 9) & BITBOARD_WITHOUT_X7;
+        if constexpr (direction == 6) return bits >> 8;
+        if constexpr (direction == 7) return (bits >> 7) & BITBOARD_WITHOUT_X0;
+    }
+
+    template <int direction>
+    inline unsigned long long BitBoard::GetMovesInDirection(unsigned long long empty) const
+    {
+        // There can be at most 6 opponent disks between the move and the end
+        unsigned long long line = Shift<direction>(Player) & Opponent;
+        line |= Shift<direction>(line) & Opponent;
+        line |= Shift<direction>(line) & Opponent;
+        line |= Shift<direction>(line) & Opponent;
+        line |= Shift<direction>(line) & Opponent;
+        line |= Shift<direction>(line) & Opponent;
+        return Shift<direction>(line) & empty;
+    }
+
+    inline unsigned long long BitBoard::GetMoves() const
+    {
+        unsigned long long empty = ~(Player | Opponent);
+        return GetMovesInDirection<0>(empty) | GetMovesInDirection<1>(empty)
+            | GetMovesInDirection<2>(empty) | GetMovesInDirection<3>(empty)
+            | GetMovesInDirection<4>(empty) | GetMovesInDirection<5>(empty)
+            | GetMovesInDirection<6>(empty) | GetMovesInDirection<7>(empty);
+    }
+
+    template <int direction>
+    inline unsigned long long BitBoard::GetFlipsInDirection(unsigned long long move) const
+    {
+        unsigned long long flips = 0;
+        unsigned long long walk = Shift<direction>(move);
+        while (walk & Opponent)
+        {
+            flips |= walk;
+            walk = Shift<direction>(walk);
+        }
+        return (walk & Player) ? flips : 0;
+    }
+
+    inline unsigned long long BitBoard::GetFlips(int index) const
+    {
+        unsigned long long move = 1ULL << index;
+        if ((Player | Opponent) & move)
+            return 0;
+        return GetFlipsInDirection<0>(move) | GetFlipsInDirection<1>(move)
+            | GetFlipsInDirection<2>(move) | GetFlipsInDirection<3>(move)
+            | GetFlipsInDirection<4>(move) | GetFlipsInDirection<5>(move)
+            | GetFlipsInDirection<6>(move) | GetFlipsInDirection<7>(move);
+    }
+
+    inline void BitBoard::MakeMove(int index, unsigned long long flips)
+    {
+        unsigned long long player = Player | flips | (1ULL << index);
+        Player = Opponent & ~flips;
+        Opponent = player;
+    }
+
+    inline void BitBoard::Pass()
+    {
+        unsigned long long player = Player;
+        Player = Opponent;
+        Opponent = player;
+    }
+
+    inline int BitBoard::GetPlayerCount() const
+    {
+        return std::popcount(Player);
+    }
+
+    inline int BitBoard::GetOpponentCount() const
+    {
+        return std::popcount(Opponent);
+    }
+
+    inline unsigned long long BitBoard::GetHash() const
+    {
+        unsigned long long hash = Player * 0x9E3779B97F4A7C15ULL ^ (Opponent + 0x632BE59BD9B4E019ULL) * 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 29;
+        hash *= 0x94D049BB133111EBULL;
+        return hash ^ (hash >> 32);
+    }
+}
@@ -518,6 +518,11 @@ namespace Reversi
         {
             Replay();
         }
+        else if (!IsAIsTurn() && (IsPlayer1AI || IsPlayer2AI) && !_Logic.IsGameOver())
+        {
+            // The player is thinking, the AI can think too
+            _AI->Ponder(_Logic);
+        }
     }
 
     bool Board::IsAIsTurn()
@@ -530,6 +535,8 @@ namespace Reversi
     void Board::MakeMove(int x, int y)
     {
         auto move = _Logic.MakeMove(x, y);
+        if (move.Changes.size() != 0)
+            _AI->ObserveMove(_Logic);
         auto now = std::chrono::steady_clock::now();
         for (int i = 0; i < move.Changes.size(); i++)
         {
@@ -551,7 +558,7 @@ namespace Reversi
         }
         if (_Logic.IsGameOver() && move.Changes.size() != 0)
         {
-            _AI->Learn(_Logic);
+            _AI->QueueLearning(_Logic);
         }
         LastMoveTime = now;
         UpdateTurnIndicator();
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+namespace Reversi
+{
+    /// @brief Small direct-mapped cache of evaluations keyed by position hash.
+    ///
+    /// The low bits of the hash select the slot and the high bits verify it.
+    /// Meant to be used as thread_local, so it has no synchronization.
+    /// @tparam Value A small trivially copyable type.
+    /// @tparam SizeLog2 Log2 of the number of entries, chosen so that the cache fits in L2.
+    template <typename Value, int SizeLog2>
+    class EvaluationCache final
+    {
+    public:
+        EvaluationCache();
+        /// @return Whether the value of the hash is found.
+        bool Get(unsigned long long hash, Value& value) const;
+        void Set(unsigned long long hash, Value value);
+        void Clear();
+    private:
+        struct Entry
+        {
+        public:
+            /// @brief The high 32 bits of the hash with the lowest bit set, 0 means empty.
+            unsigned int Check;
+            Value CachedValue;
+        };
+
+        std::vector<Entry> Entries;
+
+        static unsigned int GetCheck(unsigned long long hash);
+    };
+
+    template <typename Value, int SizeLog2>
+    EvaluationCache<Value, SizeLog2>::EvaluationCache() : Entries(1 << SizeLog2, Entry { 0, Value() })
+    {
+    }
+
+    template <typename Value, int SizeLog2>
+    inline bool EvaluationCache<Value, SizeLog2>::Get(unsigned long long hash, Value& value) const
+    {
+        const auto& entry = Entries[hash & ((1 << SizeLog2) - 1)];
+        if (entry.Check != GetCheck(hash))
+            return false;
+        value = entry.CachedValue;
+        return true;
+    }
+
+    template <typename Value, int SizeLog2>
+    inline void EvaluationCache<Value, SizeLog2>::Set(unsigned long long hash, Value value)
+    {
+        auto& entry = Entries[hash & ((1 << SizeLog2) - 1)];
+        entry.Check = GetCheck(hash);
+        entry.CachedValue = value;
+    }
+
+    template <typename Value, int SizeLog2>
+    void EvaluationCache<Value, SizeLog2>::Clear()
+    {
+        for (auto& entry : Entries)
+            entry.Check = 0;
+    }
+
+    template <typename Value, int SizeLog2>
+    inline unsigned int EvaluationCache<Value, SizeLog2>::GetCheck(unsigned long long hash)
+    {
+        return (unsigned int)(hash >> 32) | 1;
+    }
+}
@@ -2,6 +2,40 @@
 
 namespace Reversi
 {
+    constexpr unsigned long long splitmix64(unsigned long long& state)
+    {
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    struct ZobristKeys
+    {
+        /// @brief Slot index -> Side -> Key. The keys of Side::None are 0.
+        unsigned long long Slots[64][3];
+        /// @brief Side -> Key. The key of Side::None is 0.
+        unsigned long long Turn[3];
+    };
+
+    constexpr ZobristKeys make_zobrist_keys()
+    {
+        ZobristKeys keys {};
+        unsigned long long state = 0x5265766572736921ULL;
+        for (int i = 0; i < 64; i++)
+        {
+            keys.Slots[i][Side::None] = 0;
+            keys.Slots[i][Side::Black] = splitmix64(state);
+            keys.Slots[i][Side::White] = splitmix64(state);
+        }
+        keys.Turn[Side::None] = 0;
+        keys.Turn[Side::Black] = splitmix64(state);
+        keys.Turn[Side::White] = splitmix64(state);
+        return keys;
+    }
+
+    constexpr ZobristKeys ZOBRIST_KEYS = make_zobrist_keys();
+
     Logic::Change::Change(int X, int Y, Side OldState, Side NewState)
         : X(X), Y(Y), OldState(OldState), NewState(NewState)
     {}
@@ -19,6 +53,7 @@ namespace Reversi
     {
         for (int i = 0; i < 64; i++)
             Slots[i] = Side::None;
+        SlotsHash = 0;
         Set(3, 3, Side::Black);
         Set(4, 4, Side::Black);
         Set(4, 3, Side::White);
@@ -169,16 +204,23 @@ namespace Reversi
         return Side::White;
     }
 
-    std::list<Logic::Move> Logic::GetHistory() const
+    const std::list<Logic::Move>& Logic::GetHistory() const
     {
         return History;
     }
 
+    unsigned long long Logic::GetHash() const
+    {
+        return SlotsHash ^ ZOBRIST_KEYS.Turn[CurrentTurn];
+    }
+
     void Logic::Set(int x, int y, Side side)
     {
         if (x < 0 || x >= 8 || y < 0 || y >= 8)
             return;
-        Slots[y << 3 | x] = side;
+        int index = y << 3 | x;
+        SlotsHash ^= ZOBRIST_KEYS.Slots[index][Slots[index]] ^ ZOBRIST_KEYS.Slots[index][side];
+        Slots[index] = side;
     }
 
     bool Logic::CanMakeMove(int x, int y, Side turn) const
@@ -48,13 +48,17 @@ namespace Reversi
         /// @return What side wins. If IsGameOver() returns flase, still returns what side wins so far.
         ///         Side::None means draw.
         Side GetWinner() const;
-        std::list<Move> GetHistory() const;
+        const std::list<Move>& GetHistory() const;
+        /// @brief Zobrist hash of the disks and the current turn, updated incrementally by each move.
+        unsigned long long GetHash() const;
     private:
         void Set(int x, int y, Side);
         bool CanMakeMove(int x, int y, Side turn) const;
         void ApplyNextTurn();
 
         Side Slots[64];
+        /// @brief Zobrist hash of Slots, without the current turn.
+        unsigned long long SlotsHash;
         Side CurrentTurn;
         bool GameOver;
         std::list<Move> History;
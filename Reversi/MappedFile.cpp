@@ -0,0 +1,154 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Reversi
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& path) : Data(nullptr), Size(0), File(nullptr), Mapping(nullptr)
+    {
+        File = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (File == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Can't open the file to map: " + path);
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(File, &size) || size.QuadPart == 0)
+        {
+            CloseHandle(File);
+            throw std::runtime_error("Can't map an empty file: " + path);
+        }
+        Size = (std::size_t)size.QuadPart;
+        Mapping = CreateFileMappingA(File, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (Mapping != nullptr)
+            Data = (unsigned char*)MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        if (Data == nullptr)
+        {
+            if (Mapping != nullptr)
+                CloseHandle(Mapping);
+            CloseHandle(File);
+            throw std::runtime_error("Can't map the file: " + path);
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        UnmapViewOfFile(Data);
+        CloseHandle(Mapping);
+        CloseHandle(File);
+    }
+
+    void MappedFile::Flush()
+    {
+        FlushViewOfFile(Data, 0);
+    }
+
+    FileLock::FileLock(const std::string& path, bool shared, bool wait) : File(nullptr), Locked(false)
+    {
+        File = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (File == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Can't open the file to lock: " + path);
+        DWORD flags = (shared ? 0 : LOCKFILE_EXCLUSIVE_LOCK) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+        OVERLAPPED overlapped = {};
+        Locked = LockFileEx(File, flags, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+        if (!Locked && (wait || GetLastError() != ERROR_LOCK_VIOLATION))
+        {
+            CloseHandle(File);
+            throw std::runtime_error("Can't lock the file: " + path);
+        }
+    }
+
+    FileLock::~FileLock()
+    {
+        if (Locked)
+        {
+            OVERLAPPED overlapped = {};
+            UnlockFileEx(File, 0, MAXDWORD, MAXDWORD, &overlapped);
+        }
+        CloseHandle(File);
+    }
+#else
+    MappedFile::MappedFile(const std::string& path) : Data(nullptr), Size(0), File(-1)
+    {
+        File = open(path.c_str(), O_RDWR);
+        if (File == -1)
+            throw std::runtime_error("Can't open the file to map: " + path);
+        struct stat file_status;
+        if (fstat(File, &file_status) != 0 || file_status.st_size == 0)
+        {
+            close(File);
+            throw std::runtime_error("Can't map an empty file: " + path);
+        }
+        Size = (std::size_t)file_status.st_size;
+        void* data = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+        if (data == MAP_FAILED)
+        {
+            close(File);
+            throw std::runtime_error("Can't map the file: " + path);
+        }
+        Data = (unsigned char*)data;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        munmap(Data, Size);
+        close(File);
+    }
+
+    void MappedFile::Flush()
+    {
+        msync(Data, Size, MS_ASYNC);
+    }
+
+    FileLock::FileLock(const std::string& path, bool shared, bool wait) : File(-1), Locked(false)
+    {
+        File = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+        if (File == -1)
+            throw std::runtime_error("Can't open the file to lock: " + path);
+        int result;
+        do
+            result = flock(File, (shared ? LOCK_SH : LOCK_EX) | (wait ? 0 : LOCK_NB));
+        while (result != 0 && errno == EINTR);
+        Locked = result == 0;
+        if (!Locked && (wait || errno != EWOULDBLOCK))
+        {
+            close(File);
+            throw std::runtime_error("Can't lock the file: " + path);
+        }
+    }
+
+    FileLock::~FileLock()
+    {
+        // Closing the file releases the lock
+        close(File);
+    }
+#endif
+
+    unsigned char* MappedFile::GetData() const
+    {
+        return Data;
+    }
+
+    std::size_t MappedFile::GetSize() const
+    {
+        return Size;
+    }
+
+    bool FileLock::IsLocked() const
+    {
+        return Locked;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include <cstddef>
+#include <string>
+
+namespace Reversi
+{
+    /// @brief A whole existing file mapped into memory for reading and writing.
+    ///
+    /// The changes to the memory are the changes to the file, the operating system writes the changed pages
+    /// to the file in the background and when the file is unmapped.
+    class MappedFile final
+    {
+    public:
+        /// @throws std::runtime_error If the file can't be opened or mapped, or it is empty.
+        MappedFile(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        unsigned char* GetData() const;
+        std::size_t GetSize() const;
+        /// @brief Starts writing the changed pages to the file, without waiting for it to be done.
+        void Flush();
+    private:
+        unsigned char* Data;
+        std::size_t Size;
+#ifdef _WIN32
+        void* File;
+        void* Mapping;
+#else
+        int File;
+#endif
+    };
+
+    /// @brief A lock of a file between the processes, held until it's destroyed.
+    ///
+    /// The lock is advisory, it only excludes the others that lock the same file.
+    /// A process shouldn't lock a file it already holds a lock of.
+    class FileLock final
+    {
+    public:
+        /// @brief Locks the file, which is created if it doesn't exist.
+        /// @param shared Whether the lock is shared with the other shared locks, otherwise it's exclusive.
+        /// @param wait Whether to block until the file is locked, otherwise IsLocked tells whether it's locked.
+        /// @throws std::runtime_error If the file can't be opened or locked, other than being locked by others when not waiting.
+        FileLock(const std::string& path, bool shared = false, bool wait = true);
+        ~FileLock();
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+        bool IsLocked() const;
+    private:
+#ifdef _WIN32
+        void* File;
+#else
+        int File;
+#endif
+        bool Locked;
+    };
+}
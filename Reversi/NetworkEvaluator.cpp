@@ -0,0 +1,235 @@
+#include "NetworkEvaluator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace Reversi
+{
+    constexpr unsigned char NETWORK_WEIGHTS_FILE_HEADER[] = {
+        0xFF,
+        'R','e','m','i','n','i','m','a','l','i','s','m','.','R','e','v','e','r','s','i','.','N','e','t','w','o','r','k','W','e','i','g','h','t','s',
+        0xFF
+    };
+    constexpr unsigned char NETWORK_WEIGHTS_FILE_VERSION[] = { 0, 0, 0, 1 };
+
+    static_assert(NetworkWeights::FIRST_LAYER_SIZE == 64 && NetworkWeights::SECOND_LAYER_SIZE % 4 == 0,
+        "The AVX2 kernels are written for 64 first layer activations and groups of 4 second layer activations.");
+    static_assert(NetworkWeights::WEIGHT_SCALE == 1 << 6, "The AVX2 kernels scale down by shifting.");
+    static_assert(NetworkWeights::MAX_FIRST_WEIGHT * NetworkWeights::ACTIVATION_SCALE * 65 < 32768,
+        "The first layer sums of 64 discs and the bias must fit int16.");
+
+    NetworkWeights::NetworkWeights() :
+        FirstWeights{}, FirstBiases{}, SecondWeights{}, SecondBiases{}, OutputWeights{}, OutputBias(0)
+    {
+    }
+
+    std::shared_ptr<NetworkWeights> NetworkWeights::Load(const std::string& path)
+    {
+        auto result = std::make_shared<NetworkWeights>();
+        std::fstream file(path, std::fstream::binary | std::fstream::in);
+        if (!file)
+            throw std::runtime_error("Can't open the network weights file " + path + ".");
+        unsigned char file_check[sizeof(NETWORK_WEIGHTS_FILE_HEADER)];
+        file.read((char*)file_check, sizeof(NETWORK_WEIGHTS_FILE_HEADER));
+        if (!file || !std::equal(file_check, file_check + sizeof(NETWORK_WEIGHTS_FILE_HEADER), NETWORK_WEIGHTS_FILE_HEADER))
+            throw std::runtime_error(path + " is not a network weights file.");
+        file.read((char*)file_check, sizeof(NETWORK_WEIGHTS_FILE_VERSION));
+        if (!file || !std::equal(file_check, file_check + sizeof(NETWORK_WEIGHTS_FILE_VERSION), NETWORK_WEIGHTS_FILE_VERSION))
+            throw std::runtime_error(path + " has an unsupported network weights file version.");
+        file.read((char*)result->FirstWeights, sizeof(FirstWeights));
+        file.read((char*)result->FirstBiases, sizeof(FirstBiases));
+        file.read((char*)result->SecondWeights, sizeof(SecondWeights));
+        file.read((char*)result->SecondBiases, sizeof(SecondBiases));
+        file.read((char*)result->OutputWeights, sizeof(OutputWeights));
+        file.read((char*)&result->OutputBias, sizeof(OutputBias));
+        if (!file)
+            throw std::runtime_error(path + " is incomplete.");
+        return result;
+    }
+
+    void NetworkWeights::Save(const std::string& path) const
+    {
+        std::fstream file(path, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+        file.write((char*)NETWORK_WEIGHTS_FILE_HEADER, sizeof(NETWORK_WEIGHTS_FILE_HEADER));
+        file.write((char*)NETWORK_WEIGHTS_FILE_VERSION, sizeof(NETWORK_WEIGHTS_FILE_VERSION));
+        file.write((const char*)FirstWeights, sizeof(FirstWeights));
+        file.write((const char*)FirstBiases, sizeof(FirstBiases));
+        file.write((const char*)SecondWeights, sizeof(SecondWeights));
+        file.write((const char*)SecondBiases, sizeof(SecondBiases));
+        file.write((const char*)OutputWeights, sizeof(OutputWeights));
+        file.write((const char*)&OutputBias, sizeof(OutputBias));
+        if (!file)
+            throw std::runtime_error("Can't write the network weights file " + path + ".");
+    }
+
+    /// @brief Rounds value * scale, clamped to [-limit, limit] first.
+    int network_weights_quantize(float value, float limit, float scale)
+    {
+        return (int)std::round(std::clamp(value, -limit, limit) * scale);
+    }
+
+    std::shared_ptr<NetworkWeights> NetworkWeights::Quantize(const NetworkParameters& parameters)
+    {
+        if (parameters.FirstWeights.size() != INPUTS_COUNT * FIRST_LAYER_SIZE
+            || parameters.FirstBiases.size() != FIRST_LAYER_SIZE
+            || parameters.SecondWeights.size() != SECOND_LAYER_SIZE * FIRST_LAYER_SIZE
+            || parameters.SecondBiases.size() != SECOND_LAYER_SIZE
+            || parameters.OutputWeights.size() != SECOND_LAYER_SIZE)
+            throw std::logic_error("The network parameters have wrong sizes.");
+        constexpr float LAYER_SCALE = ACTIVATION_SCALE * WEIGHT_SCALE;
+        auto result = std::make_shared<NetworkWeights>();
+        for (int i = 0; i < INPUTS_COUNT; i++)
+            for (int j = 0; j < FIRST_LAYER_SIZE; j++)
+                result->FirstWeights[i][j] = network_weights_quantize(parameters.FirstWeights[i * FIRST_LAYER_SIZE + j], MAX_FIRST_WEIGHT, ACTIVATION_SCALE);
+        for (int j = 0; j < FIRST_LAYER_SIZE; j++)
+            result->FirstBiases[j] = network_weights_quantize(parameters.FirstBiases[j], MAX_FIRST_WEIGHT, ACTIVATION_SCALE);
+        for (int i = 0; i < SECOND_LAYER_SIZE; i++)
+        {
+            for (int j = 0; j < FIRST_LAYER_SIZE; j++)
+                result->SecondWeights[i][j] = network_weights_quantize(parameters.SecondWeights[i * FIRST_LAYER_SIZE + j], MAX_SECOND_WEIGHT, WEIGHT_SCALE);
+            result->SecondBiases[i] = network_weights_quantize(parameters.SecondBiases[i], 1 << 16, LAYER_SCALE);
+            result->OutputWeights[i] = network_weights_quantize(parameters.OutputWeights[i], 32767.0f / WEIGHT_SCALE, WEIGHT_SCALE);
+        }
+        result->OutputBias = network_weights_quantize(parameters.OutputBias, 1 << 16, LAYER_SCALE);
+        return result;
+    }
+
+    float NetworkWeights::Predict(const BitBoard& board) const
+    {
+        float prediction;
+        PredictBatch(&board, 1, &prediction);
+        return prediction;
+    }
+
+    void NetworkWeights::PredictBatch(const BitBoard* boards, int count, float* predictions) const
+    {
+        alignas(32) unsigned char activations[BATCH_SIZE * FIRST_LAYER_SIZE];
+        for (int start = 0; start < count; start += BATCH_SIZE)
+        {
+            int batch_count = std::min(BATCH_SIZE, count - start);
+            for (int i = 0; i < batch_count; i++)
+                CalculateFirstLayer(boards[start + i], activations + i * FIRST_LAYER_SIZE);
+            CalculateOutput(activations, batch_count, predictions + start);
+        }
+    }
+
+#ifdef __AVX2__
+
+    void NetworkWeights::CalculateFirstLayer(const BitBoard& board, unsigned char* activations) const
+    {
+        __m256i sums[4];
+        for (int i = 0; i < 4; i++)
+            sums[i] = _mm256_load_si256((const __m256i*)FirstBiases + i);
+        for (unsigned long long discs = board.Player; discs; discs &= discs - 1)
+        {
+            const __m256i* row = (const __m256i*)FirstWeights[std::countr_zero(discs)];
+            for (int i = 0; i < 4; i++)
+                sums[i] = _mm256_add_epi16(sums[i], _mm256_load_si256(row + i));
+        }
+        for (unsigned long long discs = board.Opponent; discs; discs &= discs - 1)
+        {
+            const __m256i* row = (const __m256i*)FirstWeights[64 + std::countr_zero(discs)];
+            for (int i = 0; i < 4; i++)
+                sums[i] = _mm256_add_epi16(sums[i], _mm256_load_si256(row + i));
+        }
+        const __m256i max_activation = _mm256_set1_epi16(ACTIVATION_SCALE);
+        for (int i = 0; i < 2; i++)
+        {
+            // The negative sums saturate to 0, and packing works within 128-bit lanes, so the quadwords are put back in order
+            __m256i packed = _mm256_packus_epi16(_mm256_min_epi16(sums[2 * i], max_activation), _mm256_min_epi16(sums[2 * i + 1], max_activation));
+            _mm256_store_si256((__m256i*)activations + i, _mm256_permute4x64_epi64(packed, 0b11011000));
+        }
+    }
+
+    void NetworkWeights::CalculateOutput(const unsigned char* activations, int count, float* predictions) const
+    {
+        alignas(16) int second_activations[BATCH_SIZE][SECOND_LAYER_SIZE];
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m128i max_activation = _mm_set1_epi32(ACTIVATION_SCALE);
+        for (int group = 0; group < SECOND_LAYER_SIZE; group += 4)
+        {
+            // The weights of 4 activations stay in registers for the whole batch
+            __m256i weights[8];
+            for (int i = 0; i < 4; i++)
+            {
+                weights[2 * i] = _mm256_load_si256((const __m256i*)SecondWeights[group + i]);
+                weights[2 * i + 1] = _mm256_load_si256((const __m256i*)SecondWeights[group + i] + 1);
+            }
+            __m128i biases = _mm_loadu_si128((const __m128i*)(SecondBiases + group));
+            for (int position = 0; position < count; position++)
+            {
+                __m256i inputs_low = _mm256_load_si256((const __m256i*)(activations + position * FIRST_LAYER_SIZE));
+                __m256i inputs_high = _mm256_load_si256((const __m256i*)(activations + position * FIRST_LAYER_SIZE) + 1);
+                __m256i sums[4];
+                for (int i = 0; i < 4; i++)
+                {
+                    // Each pair of products is at most 2 * 127 * 127, so the int16 sums can't saturate
+                    __m256i low = _mm256_madd_epi16(_mm256_maddubs_epi16(inputs_low, weights[2 * i]), ones);
+                    __m256i high = _mm256_madd_epi16(_mm256_maddubs_epi16(inputs_high, weights[2 * i + 1]), ones);
+                    sums[i] = _mm256_add_epi32(low, high);
+                }
+                __m256i sum = _mm256_hadd_epi32(_mm256_hadd_epi32(sums[0], sums[1]), _mm256_hadd_epi32(sums[2], sums[3]));
+                __m128i result = _mm_add_epi32(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)), biases);
+                result = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(result, 6), _mm_setzero_si128()), max_activation);
+                _mm_store_si128((__m128i*)(second_activations[position] + group), result);
+            }
+        }
+        for (int position = 0; position < count; position++)
+        {
+            int output = OutputBias;
+            for (int i = 0; i < SECOND_LAYER_SIZE; i++)
+                output += second_activations[position][i] * OutputWeights[i];
+            predictions[position] = output / (float)(ACTIVATION_SCALE * WEIGHT_SCALE);
+        }
+    }
+
+#else
+
+    void NetworkWeights::CalculateFirstLayer(const BitBoard& board, unsigned char* activations) const
+    {
+        int sums[FIRST_LAYER_SIZE];
+        for (int i = 0; i < FIRST_LAYER_SIZE; i++)
+            sums[i] = FirstBiases[i];
+        for (unsigned long long discs = board.Player; discs; discs &= discs - 1)
+        {
+            const short* row = FirstWeights[std::countr_zero(discs)];
+            for (int i = 0; i < FIRST_LAYER_SIZE; i++)
+                sums[i] += row[i];
+        }
+        for (unsigned long long discs = board.Opponent; discs; discs &= discs - 1)
+        {
+            const short* row = FirstWeights[64 + std::countr_zero(discs)];
+            for (int i = 0; i < FIRST_LAYER_SIZE; i++)
+                sums[i] += row[i];
+        }
+        for (int i = 0; i < FIRST_LAYER_SIZE; i++)
+            activations[i] = std::clamp(sums[i], 0, ACTIVATION_SCALE);
+    }
+
+    void NetworkWeights::CalculateOutput(const unsigned char* activations, int count, float* predictions) const
+    {
+        for (int position = 0; position < count; position++)
+        {
+            const unsigned char* inputs = activations + position * FIRST_LAYER_SIZE;
+            int output = OutputBias;
+            for (int i = 0; i < SECOND_LAYER_SIZE; i++)
+            {
+                int sum = SecondBiases[i];
+                for (int j = 0; j < FIRST_LAYER_SIZE; j++)
+                    sum += inputs[j] * SecondWeights[i][j];
+                // Rounded down by shifting, as the AVX2 kernel does
+                output += std::clamp(sum >> 6, 0, ACTIVATION_SCALE) * OutputWeights[i];
+            }
+            predictions[position] = output / (float)(ACTIVATION_SCALE * WEIGHT_SCALE);
+        }
+    }
+
+#endif
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include "BitBoard.h"
+#include "SearchEngine.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Reversi
+{
+    /// @brief The unquantized parameters of NetworkWeights, as the ReversiTuner tool trains them.
+    ///
+    /// The activations are clamped to [0, 1], and the output is the predicted final disc differential.
+    struct NetworkParameters
+    {
+    public:
+        /// @brief NetworkWeights::INPUTS_COUNT rows of NetworkWeights::FIRST_LAYER_SIZE.
+        std::vector<float> FirstWeights;
+        std::vector<float> FirstBiases;
+        /// @brief NetworkWeights::SECOND_LAYER_SIZE rows of NetworkWeights::FIRST_LAYER_SIZE.
+        std::vector<float> SecondWeights;
+        std::vector<float> SecondBiases;
+        std::vector<float> OutputWeights;
+        float OutputBias;
+    };
+
+    /// @brief A small quantized network that predicts the final disc differential from the disc planes.
+    ///
+    /// The inputs are a plane of the discs of BitBoard::Player and a plane of BitBoard::Opponent.
+    /// The first layer is int16 and only adds the rows of the discs on the board,
+    /// the second layer is int8 on the activations in range [0, ACTIVATION_SCALE].
+    /// With AVX2 enabled at compile time the layers use AVX2 kernels, otherwise the same math in scalar code.
+    class NetworkWeights final
+    {
+    public:
+        static constexpr int INPUTS_COUNT = 128;
+        static constexpr int FIRST_LAYER_SIZE = 64;
+        static constexpr int SECOND_LAYER_SIZE = 32;
+        /// @brief The quantized value of an activation of 1.
+        static constexpr int ACTIVATION_SCALE = 127;
+        /// @brief The quantized value of a weight of 1 in the second and the output layers.
+        static constexpr int WEIGHT_SCALE = 64;
+        /// @brief The bounds of the first layer weights and biases, so that the int16 sums can't overflow.
+        static constexpr float MAX_FIRST_WEIGHT = 2;
+        /// @brief The bounds of the second layer weights, so that they fit int8.
+        static constexpr float MAX_SECOND_WEIGHT = 127.0f / WEIGHT_SCALE;
+
+        /// @brief All weights 0.
+        NetworkWeights();
+        /// @throws std::runtime_error If the file can't be read or is not a supported network file.
+        static std::shared_ptr<NetworkWeights> Load(const std::string& path);
+        /// @throws std::runtime_error If the file can't be written.
+        void Save(const std::string& path) const;
+        /// @brief Rounds the parameters to the quantized weights, clamping them to the bounds.
+        static std::shared_ptr<NetworkWeights> Quantize(const NetworkParameters&);
+
+        /// @return The predicted final disc differential for BitBoard::Player.
+        float Predict(const BitBoard& board) const;
+        /// @brief Predicts the boards together, so that each weight row is loaded once for all of them.
+        /// @param predictions Filled with count predictions.
+        void PredictBatch(const BitBoard* boards, int count, float* predictions) const;
+    private:
+        /// @brief The boards predicted together by PredictBatch.
+        static constexpr int BATCH_SIZE = 8;
+
+        alignas(32) short FirstWeights[INPUTS_COUNT][FIRST_LAYER_SIZE];
+        alignas(32) short FirstBiases[FIRST_LAYER_SIZE];
+        alignas(32) signed char SecondWeights[SECOND_LAYER_SIZE][FIRST_LAYER_SIZE];
+        int SecondBiases[SECOND_LAYER_SIZE];
+        short OutputWeights[SECOND_LAYER_SIZE];
+        int OutputBias;
+
+        /// @param activations Filled with FIRST_LAYER_SIZE activations.
+        void CalculateFirstLayer(const BitBoard& board, unsigned char* activations) const;
+        /// @param activations count * FIRST_LAYER_SIZE activations.
+        /// @param predictions Filled with count predictions, count is at most BATCH_SIZE.
+        void CalculateOutput(const unsigned char* activations, int count, float* predictions) const;
+    };
+
+    /// @brief Evaluates by the quantized network.
+    struct NetworkEvaluator final
+    {
+    public:
+        /// @brief Not null, not changed while searching.
+        std::shared_ptr<const NetworkWeights> Weights;
+
+        inline int Evaluate(const BitBoard& board) const;
+    };
+
+    inline int NetworkEvaluator::Evaluate(const BitBoard& board) const
+    {
+        constexpr float MAX_SCORE = 64 * SearchEngineTypes::DISC_SCORE - 1;
+        float score = Weights->Predict(board) * SearchEngineTypes::DISC_SCORE;
+        return (int)(score < -MAX_SCORE ? -MAX_SCORE : (score > MAX_SCORE ? MAX_SCORE : score));
+    }
+}
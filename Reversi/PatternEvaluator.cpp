@@ -0,0 +1,177 @@
+#include "PatternEvaluator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace Reversi
+{
+    /// @brief A placement of a pattern on the board.
+    struct PatternInstance
+    {
+    public:
+        int CellsCount;
+        /// @brief The slot indices, the first one is the least significant ternary digit of the configuration.
+        int Cells[10];
+        /// @brief The index of the first weight of the pattern in a phase.
+        int Offset;
+    };
+
+    /// @brief The pattern instances and the number of weights in a phase.
+    struct PatternTable
+    {
+    public:
+        PatternInstance Instances[PatternWeights::FEATURES_COUNT];
+        int PhaseWeightsCount;
+    };
+
+    /// @brief Generates the instances of the patterns by the 8 symmetries of the board.
+    PatternTable create_pattern_table()
+    {
+        /// @brief (x, y) of the cells of each pattern in one placement.
+        const std::vector<std::vector<std::tuple<int, int>>> patterns = {
+            // Edge with the X-squares
+            { {0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 0}, {6, 0}, {7, 0}, {1, 1}, {6, 1} },
+            // Corner 3x3
+            { {0, 0}, {1, 0}, {2, 0}, {0, 1}, {1, 1}, {2, 1}, {0, 2}, {1, 2}, {2, 2} },
+            // Corner 5x2
+            { {0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {0, 1}, {1, 1}, {2, 1}, {3, 1}, {4, 1} },
+            // Lines parallel to the edges
+            { {0, 1}, {1, 1}, {2, 1}, {3, 1}, {4, 1}, {5, 1}, {6, 1}, {7, 1} },
+            { {0, 2}, {1, 2}, {2, 2}, {3, 2}, {4, 2}, {5, 2}, {6, 2}, {7, 2} },
+            { {0, 3}, {1, 3}, {2, 3}, {3, 3}, {4, 3}, {5, 3}, {6, 3}, {7, 3} },
+            // Diagonals
+            { {0, 0}, {1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}, {7, 7} },
+            { {0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 6}, {6, 7} },
+            { {0, 2}, {1, 3}, {2, 4}, {3, 5}, {4, 6}, {5, 7} },
+            { {0, 3}, {1, 4}, {2, 5}, {3, 6}, {4, 7} },
+            { {0, 4}, {1, 5}, {2, 6}, {3, 7} },
+        };
+        PatternTable table;
+        int count = 0;
+        int offset = 0;
+        for (const auto& pattern : patterns)
+        {
+            std::vector<std::vector<int>> placed_cell_sets;
+            for (int symmetry = 0; symmetry < 8; symmetry++)
+            {
+                PatternInstance instance;
+                instance.CellsCount = pattern.size();
+                instance.Offset = offset;
+                for (int i = 0; i < pattern.size(); i++)
+                {
+                    auto [x, y] = pattern[i];
+                    if (symmetry & 1)
+                        x = 7 - x;
+                    if (symmetry & 2)
+                        y = 7 - y;
+                    if (symmetry & 4)
+                        std::swap(x, y);
+                    instance.Cells[i] = y << 3 | x;
+                }
+                // Symmetric patterns map to the same cells more than once
+                std::vector<int> cell_set(instance.Cells, instance.Cells + instance.CellsCount);
+                std::sort(cell_set.begin(), cell_set.end());
+                if (std::find(placed_cell_sets.begin(), placed_cell_sets.end(), cell_set) != placed_cell_sets.end())
+                    continue;
+                placed_cell_sets.push_back(cell_set);
+                if (count == PatternWeights::FEATURES_COUNT)
+                    throw std::logic_error("Too many pattern instances.");
+                table.Instances[count++] = instance;
+            }
+            int configurations_count = 1;
+            for (int i = 0; i < pattern.size(); i++)
+                configurations_count *= 3;
+            offset += configurations_count;
+        }
+        if (count != PatternWeights::FEATURES_COUNT)
+            throw std::logic_error("Too few pattern instances.");
+        table.PhaseWeightsCount = offset;
+        return table;
+    }
+
+    const PatternTable PATTERN_TABLE = create_pattern_table();
+
+    constexpr unsigned char PATTERN_WEIGHTS_FILE_HEADER[] = {
+        0xFF,
+        'R','e','m','i','n','i','m','a','l','i','s','m','.','R','e','v','e','r','s','i','.','P','a','t','t','e','r','n','W','e','i','g','h','t','s',
+        0xFF
+    };
+    constexpr unsigned char PATTERN_WEIGHTS_FILE_VERSION[] = { 0, 0, 0, 1 };
+
+    PatternWeights::PatternWeights() : Weights(PHASES_COUNT * PATTERN_TABLE.PhaseWeightsCount, 0)
+    {
+    }
+
+    std::shared_ptr<PatternWeights> PatternWeights::Load(const std::string& path)
+    {
+        auto result = std::make_shared<PatternWeights>();
+        std::fstream file(path, std::fstream::binary | std::fstream::in);
+        if (!file)
+            throw std::runtime_error("Can't open the pattern weights file " + path + ".");
+        unsigned char file_check[sizeof(PATTERN_WEIGHTS_FILE_HEADER)];
+        file.read((char*)file_check, sizeof(PATTERN_WEIGHTS_FILE_HEADER));
+        if (!file || !std::equal(file_check, file_check + sizeof(PATTERN_WEIGHTS_FILE_HEADER), PATTERN_WEIGHTS_FILE_HEADER))
+            throw std::runtime_error(path + " is not a pattern weights file.");
+        file.read((char*)file_check, sizeof(PATTERN_WEIGHTS_FILE_VERSION));
+        if (!file || !std::equal(file_check, file_check + sizeof(PATTERN_WEIGHTS_FILE_VERSION), PATTERN_WEIGHTS_FILE_VERSION))
+            throw std::runtime_error(path + " has an unsupported pattern weights file version.");
+        file.read((char*)result->Weights.data(), result->Weights.size() * sizeof(float));
+        if (!file)
+            throw std::runtime_error(path + " is incomplete.");
+        return result;
+    }
+
+    void PatternWeights::Save(const std::string& path) const
+    {
+        std::fstream file(path, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+        file.write((char*)PATTERN_WEIGHTS_FILE_HEADER, sizeof(PATTERN_WEIGHTS_FILE_HEADER));
+        file.write((char*)PATTERN_WEIGHTS_FILE_VERSION, sizeof(PATTERN_WEIGHTS_FILE_VERSION));
+        file.write((const char*)Weights.data(), Weights.size() * sizeof(float));
+        if (!file)
+            throw std::runtime_error("Can't write the pattern weights file " + path + ".");
+    }
+
+    void PatternWeights::GetFeatures(const BitBoard& board, int* indices)
+    {
+        // 4 to 19 discs is the first phase, 52 to 64 the last
+        int phase = std::min(PHASES_COUNT - 1, (board.GetPlayerCount() + board.GetOpponentCount() - 4) / 16);
+        int phase_offset = phase * PATTERN_TABLE.PhaseWeightsCount;
+        for (int i = 0; i < FEATURES_COUNT; i++)
+        {
+            const auto& instance = PATTERN_TABLE.Instances[i];
+            int configuration = 0;
+            for (int j = instance.CellsCount - 1; j >= 0; j--)
+            {
+                int cell = instance.Cells[j];
+                configuration = configuration * 3 + (int)((board.Player >> cell) & 1) + 2 * (int)((board.Opponent >> cell) & 1);
+            }
+            indices[i] = phase_offset + instance.Offset + configuration;
+        }
+    }
+
+    float PatternWeights::Predict(const BitBoard& board) const
+    {
+        int indices[FEATURES_COUNT];
+        GetFeatures(board, indices);
+        float result = 0;
+        for (int i = 0; i < FEATURES_COUNT; i++)
+            result += Weights[indices[i]];
+        return result;
+    }
+
+    int PatternWeights::GetWeightsCount() const
+    {
+        return Weights.size();
+    }
+
+    float* PatternWeights::GetWeights()
+    {
+        return Weights.data();
+    }
+
+    const float* PatternWeights::GetWeights() const
+    {
+        return Weights.data();
+    }
+}
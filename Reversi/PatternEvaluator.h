@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include "BitBoard.h"
+#include "SearchEngine.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Reversi
+{
+    /// @brief Learned weights for each configuration of some patterns of slots, for each game phase.
+    ///
+    /// A pattern, like an edge or a corner area, has an instance for each of its symmetric placements,
+    /// and the instances share the weights. The weights predict the final disc differential,
+    /// and are tuned by the ReversiTuner tool.
+    class PatternWeights final
+    {
+    public:
+        static constexpr int PHASES_COUNT = 4;
+        /// @brief The number of pattern instances, which is the number of weights that apply to a position.
+        static constexpr int FEATURES_COUNT = 46;
+
+        /// @brief All weights 0.
+        PatternWeights();
+        /// @throws std::runtime_error If the file can't be read or is not a supported weights file.
+        static std::shared_ptr<PatternWeights> Load(const std::string& path);
+        /// @throws std::runtime_error If the file can't be written.
+        void Save(const std::string& path) const;
+
+        /// @brief Gets the index of the weight of each pattern instance for the board.
+        /// @param indices Filled with FEATURES_COUNT indices.
+        static void GetFeatures(const BitBoard& board, int* indices);
+        /// @return The predicted final disc differential for BitBoard::Player.
+        float Predict(const BitBoard& board) const;
+        int GetWeightsCount() const;
+        float* GetWeights();
+        const float* GetWeights() const;
+    private:
+        std::vector<float> Weights;
+    };
+
+    /// @brief Evaluates by the tuned pattern weights.
+    struct PatternEvaluator final
+    {
+    public:
+        /// @brief Not null, not changed while searching.
+        std::shared_ptr<const PatternWeights> Weights;
+
+        inline int Evaluate(const BitBoard& board) const;
+    };
+
+    inline int PatternEvaluator::Evaluate(const BitBoard& board) const
+    {
+        constexpr float MAX_SCORE = 64 * SearchEngineTypes::DISC_SCORE - 1;
+        float score = Weights->Predict(board) * SearchEngineTypes::DISC_SCORE;
+        return (int)(score < -MAX_SCORE ? -MAX_SCORE : (score > MAX_SCORE ? MAX_SCORE : score));
+    }
+}
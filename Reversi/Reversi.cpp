@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <stdexcept>
 #include <thread>
 
 using namespace std::chrono_literals;
@@ -15,12 +16,32 @@ int main()
     std::cout << "A file named 'ReversiEvolvingAI.dat' will be created in the working directory if not present, to store AI data.\n";
     std::cout << "The AI starts from scratch and will learn little by little.\n";
     std::cout << "You can make a backup of ReversiEvolvingAI.dat to save the state of the AI.\n";
+    std::cout << "Several instances running in the same working directory learn into the same AI data together.\n";
 #if REVERSI_DEBUG
     std::cout << "\nDEBUG MODE\n\n";
 #endif
 
     std::shared_ptr<Reversi::Window> window(new Reversi::Window(std::string(Reversi::Info::NAME) + " v" + Reversi::Info::VERSION));
-    std::shared_ptr<Reversi::AI> ai(new Reversi::EvolvingAI("ReversiEvolvingAI.dat"));
+    std::shared_ptr<Reversi::AI> ai;
+    try
+    {
+        ai.reset(new Reversi::EvolvingAI("ReversiEvolvingAI.dat", 0.1, 0.1, Reversi::EvolvingAI::Storage::Shared));
+    }
+    catch (const std::runtime_error& error)
+    {
+        // Locking or mapping the files isn't possible everywhere, then this instance learns on its own
+        std::cout << "Can't share the AI data with the other instances: " << error.what() << '\n';
+        std::cout << "This instance rewrites ReversiEvolvingAI.dat after each game instead.\n";
+        try
+        {
+            ai.reset(new Reversi::EvolvingAI("ReversiEvolvingAI.dat", 0.1, 0.1, Reversi::EvolvingAI::Storage::Rewrite));
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cout << "Can't load the AI data: " << error.what() << '\n';
+            return 1;
+        }
+    }
     Reversi::Board board(window, ai);
     while (!window->ShouldClose())
     {
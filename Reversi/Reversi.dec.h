@@ -53,9 +53,19 @@ namespace Reversi
     class MouseEventManager;
     class Board;
     class Logic;
+    class MappedFile;
+    class FileLock;
+    struct BitBoard;
     class AI;
     class DecisionTreeAI;
     class EvolvingAI;
+    class MCTSAI;
+    class NetworkWeights;
+    class PatternWeights;
+    class TDLearner;
+    class ScratchArena;
+    class ThreadPool;
+    class TaskGroup;
     class ShaderProgram;
     class Renderer;
 }
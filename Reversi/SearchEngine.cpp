@@ -0,0 +1,33 @@
+#include "SearchEngine.h"
+
+#include "AI.h"
+#include "NetworkEvaluator.h"
+#include "PatternEvaluator.h"
+#include "SearchEngine.inl"
+
+#include <sstream>
+
+namespace Reversi
+{
+    std::string SearchEngineTypes::SearchStatistics::ToString() const
+    {
+        std::ostringstream result;
+        result << "depth " << DepthReached
+            << ", nodes " << Nodes << " (" << Leaves << " leaves)"
+            << ", " << Seconds << " s, " << (long long)NodesPerSecond << " nodes/s"
+            << ", first move cutoffs " << FirstMoveCutoffRate * 100 << "%"
+            << ", effective branching factor " << EffectiveBranchingFactor
+            << ", transposition hits " << TranspositionHitRate * 100 << "%"
+            << ", collisions " << TranspositionCollisionRate * 100 << "%"
+            << ", iterations (s):";
+        for (auto seconds : IterationSeconds)
+            result << " " << seconds;
+        return result.str();
+    }
+
+    // The engines in use, and the baseline configuration to compare the experiments with
+    template class SearchEngine<NetworkEvaluator, EvolvingAIMoveOrderer>;
+    template class SearchEngine<PatternEvaluator, EvolvingAIMoveOrderer>;
+    template class SearchEngine<DiscRatioEvaluator, EvolvingAIMoveOrderer>;
+    template class SearchEngine<DiscRatioEvaluator, NaturalMoveOrderer>;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include "BitBoard.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace Reversi
+{
+    /// @brief The types shared by all SearchEngine instantiations.
+    class SearchEngineTypes
+    {
+    public:
+        /// @brief The score of one disc of difference.
+        ///
+        /// Scores are exact disc differentials at game over, and scaled evaluations otherwise.
+        static constexpr int DISC_SCORE = 100;
+
+        enum class Bound : char { Exact, Lower, Upper };
+
+        struct MoveAnalysis
+        {
+        public:
+            int X;
+            int Y;
+            /// @brief The score for the side to move in DISC_SCORE units, exact or bounded as ScoreBound says.
+            int Score;
+            Bound ScoreBound;
+            /// @brief The expected continuation, starting with the move itself.
+            std::vector<std::tuple<int, int>> PrincipalVariation;
+        };
+
+        /// @brief What a search did, for tuning and capacity planning.
+        struct SearchStatistics
+        {
+        public:
+            /// @brief The visited nodes, including the leaves.
+            long long Nodes = 0;
+            /// @brief The evaluated leaves.
+            long long Leaves = 0;
+            double Seconds = 0;
+            double NodesPerSecond = 0;
+            /// @brief The ratio of the cutoffs that happened at the first move searched, in range [0, 1].
+            double FirstMoveCutoffRate = 0;
+            /// @brief The ratio of the node counts of the last two iterations.
+            double EffectiveBranchingFactor = 0;
+            /// @brief The depth of the last completed iteration in plies.
+            int DepthReached = 0;
+            long long TranspositionProbes = 0;
+            /// @brief The ratio of the probes that found their state, in range [0, 1].
+            double TranspositionHitRate = 0;
+            /// @brief The ratio of the probes that found another state in the slot, in range [0, 1].
+            double TranspositionCollisionRate = 0;
+            /// @brief The time spent on each iteration of iterative deepening in seconds.
+            std::vector<double> IterationSeconds;
+
+            /// @return One line summary.
+            std::string ToString() const;
+        };
+    };
+
+    /// @brief Evaluates by the ratio of the discs, scaled to a full board.
+    struct DiscRatioEvaluator final
+    {
+    public:
+        inline int Evaluate(const BitBoard& board) const;
+    };
+
+    /// @brief Keeps the moves in the order they are generated.
+    struct NaturalMoveOrderer final
+    {
+    public:
+        inline void Order(const Logic& state, std::tuple<int, int>* moves, int count) const;
+    };
+
+    /// @brief Alpha-beta search with iterative deepening, a transposition table and pondering.
+    ///
+    /// The policies are resolved at compile time, so that they're inlined into the node loop.
+    /// The member functions are defined in SearchEngine.inl. SearchEngine.cpp instantiates the engines in use,
+    /// an engine with other policies is instantiated by including SearchEngine.inl where it's used.
+    /// @tparam Evaluator Has int Evaluate(const BitBoard&) const, the score of a position that is not game over
+    ///                   for BitBoard::Player in DISC_SCORE units, in range (-64 * DISC_SCORE, 64 * DISC_SCORE).
+    ///                   The evaluations are cached per engine, so it should only depend on the board.
+    /// @tparam MoveOrderer Has void Order(const Logic&, std::tuple<int, int>* moves, int count) const,
+    ///                     which reorders the (x, y) moves of the state, the most promising first.
+    ///                     It's used at the inner nodes, after the best move of the transposition table.
+    template <typename Evaluator, typename MoveOrderer>
+    class SearchEngine : public SearchEngineTypes
+    {
+    public:
+        SearchEngine(int depth, Evaluator evaluator = Evaluator(), MoveOrderer move_orderer = MoveOrderer());
+        ~SearchEngine();
+
+        SearchEngine(const SearchEngine&) = delete;
+        SearchEngine(SearchEngine&&) = delete;
+        SearchEngine& operator=(const SearchEngine&) = delete;
+        SearchEngine& operator=(SearchEngine&&) = delete;
+
+        std::optional<std::tuple<int, int>> Decide(const Logic& state);
+        /// @brief Searches the replies of the player to move in the background, most likely replies first.
+        ///
+        /// Decide returns the pondered result immediately if the actual reply has been searched,
+        /// otherwise it searches with the transposition table that pondering has filled.
+        void Ponder(const Logic& state);
+        void StopPondering();
+        /// @brief Scores the legal moves of the state in one search with a shared transposition table.
+        /// @param count The number of best moves to score exactly, or 0 for all of them.
+        ///              The other moves get upper bounds, which is much cheaper.
+        /// @return An analysis for each legal move, best first.
+        std::vector<MoveAnalysis> Analyze(const Logic& state, int count = 0);
+        /// @brief The statistics of the last search done by Decide or Analyze. Pondering doesn't change it.
+        SearchStatistics GetLastSearchStatistics();
+        /// @brief Whether to print the statistics of each Decide call to the standard output.
+        void SetLogStatistics(bool);
+        int GetDepth();
+        void SetDepth(int);
+        long long GetNodeBudget();
+        /// @brief Sets the number of nodes to search per decision, 0 for searching by depth.
+        ///
+        /// With a node budget, the search deepens until the budget runs out, regardless of the depth,
+        /// and the decisions don't depend on the speed of the machine. Pondering is disabled.
+        void SetNodeBudget(long long);
+    private:
+        struct TranspositionEntry
+        {
+        public:
+            unsigned long long Hash;
+            int Score;
+            /// @brief The remaining depth the score is calculated with. -1 means empty.
+            signed char Depth;
+            Bound ScoreBound;
+            /// @brief The side that the score is calculated for.
+            Side ScoreSide;
+            /// @brief The best move found, or -1 if not known.
+            signed char BestX;
+            signed char BestY;
+        };
+
+        /// @brief What a search found at its root, kept to seed the next search.
+        struct RootSearch
+        {
+        public:
+            /// @brief The root state hash.
+            unsigned long long Hash = 0;
+            /// @brief The root moves, best first.
+            std::vector<MoveAnalysis> MoveScores;
+            /// @brief The principal variation, starting with the decided move.
+            std::vector<std::tuple<int, int>> PrincipalVariation;
+            /// @brief The state hash after each move of PrincipalVariation.
+            std::vector<unsigned long long> PrincipalVariationHashes;
+        };
+
+        Evaluator LeafEvaluator;
+        MoveOrderer Orderer;
+        /// @brief Mixed into the evaluation cache keys, so that the engines don't share the cached evaluations.
+        unsigned long long EvaluationCacheSalt;
+        int Depth;
+        long long NodeBudget;
+        /// @brief Kept between the searches, so that the next search can reuse the subtree it enters.
+        std::vector<TranspositionEntry> TranspositionTable;
+
+        /// @brief The last search done by Decide or Analyze, or the pondered search that Decide used.
+        ///        Pondering seeds from it and doesn't change it.
+        RootSearch LastRootSearch;
+
+        SearchStatistics LastStatistics;
+        bool LogStatistics;
+
+        /// @brief State hash -> The search of the state while pondering, whose best move is the decided move.
+        std::map<unsigned long long, RootSearch> PonderResults;
+        unsigned long long PonderedStateHash;
+        /// @brief Whether pondering is started and not stopped yet, even if it's done.
+        bool IsPondering;
+        TaskGroup PonderTask;
+        std::atomic<bool> StopRequested;
+
+        /// @brief Searches with iterative deepening, seeded from the last search if the state is reached by it.
+        /// @param count The number of best moves to score exactly, or 0 for all of them.
+        /// @param root_search The last search, set to this search unless it's stopped or there are no moves.
+        /// @param statistics Filled with the statistics of the search if not null.
+        /// @return An analysis for each legal move, best first. Empty if stopped.
+        std::vector<MoveAnalysis> SearchRoot(const Logic& state, int count, RootSearch& root_search, SearchStatistics* statistics);
+        /// @brief Follows the best moves of the transposition table after making the move.
+        /// @param depth The maximum number of moves after the move.
+        std::vector<std::tuple<int, int>> GetPrincipalVariation(Logic state, int x, int y, int depth);
+        void PonderReplies(Logic state);
+        TranspositionEntry& TranspositionEntryAt(unsigned long long hash);
+        /// @return Whether the search on this thread has used up the node budget.
+        bool IsOutOfNodeBudget();
+        int CalculateScore(const Logic& state, Side side, int depth, int alpha, int beta);
+        /// @return The exact disc differential if the game is over, otherwise the evaluation of Evaluator.
+        int CalculateScoreTerminal(const Logic& state, Side side);
+    };
+
+    inline int DiscRatioEvaluator::Evaluate(const BitBoard& board) const
+    {
+        int player_count = board.GetPlayerCount();
+        int opponent_count = board.GetOpponentCount();
+        return (player_count - opponent_count) * 64 * SearchEngineTypes::DISC_SCORE / (player_count + opponent_count);
+    }
+
+    inline void NaturalMoveOrderer::Order(const Logic& state, std::tuple<int, int>* moves, int count) const
+    {
+    }
+}
@@ -0,0 +1,628 @@
+#pragma once
+
+// The member functions of SearchEngine. SearchEngine.cpp instantiates the engines in use,
+// include this file to instantiate an engine with other policies, like an experimental evaluator.
+
+#include "SearchEngine.h"
+
+#include "EvaluationCache.h"
+#include "Logic.h"
+
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <stdexcept>
+
+namespace Reversi
+{
+    constexpr static int SEARCH_ENGINE_TRANSPOSITION_TABLE_SIZE = 1 << 18; // Must be a power of 2
+
+    /// @brief Raw counters of a search.
+    struct SearchEngineCounters
+    {
+    public:
+        long long Nodes;
+        long long Leaves;
+        long long Cutoffs;
+        long long FirstMoveCutoffs;
+        long long TranspositionProbes;
+        long long TranspositionHits;
+        long long TranspositionCollisions;
+    };
+
+    /// @brief The counters of the search running on each thread, plain integers to keep the hot path cheap.
+    inline thread_local SearchEngineCounters search_engine_counters;
+    /// @brief The SearchEngine::EvaluationCacheSalt of the search running on each thread.
+    inline thread_local unsigned long long search_engine_evaluation_cache_salt;
+    inline std::atomic<unsigned long long> search_engine_evaluation_cache_salt_generation(0);
+
+    template <typename Evaluator, typename MoveOrderer>
+    SearchEngine<Evaluator, MoveOrderer>::SearchEngine(int depth, Evaluator evaluator, MoveOrderer move_orderer)
+        : LeafEvaluator(evaluator), Orderer(move_orderer),
+          EvaluationCacheSalt(++search_engine_evaluation_cache_salt_generation * 0x9E3779B97F4A7C15ULL),
+          Depth(depth), NodeBudget(0),
+          TranspositionTable(SEARCH_ENGINE_TRANSPOSITION_TABLE_SIZE, TranspositionEntry { 0, 0, -1, Bound::Exact, Side::None, -1, -1 }),
+          LogStatistics(false), PonderedStateHash(0), IsPondering(false), StopRequested(false)
+    {
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    SearchEngine<Evaluator, MoveOrderer>::~SearchEngine()
+    {
+        StopPondering();
+    }
+
+    constexpr static int MIN_SCORE = -65 * SearchEngineTypes::DISC_SCORE;
+    constexpr static int MAX_SCORE = 65 * SearchEngineTypes::DISC_SCORE;
+
+    template <typename Evaluator, typename MoveOrderer>
+    std::optional<std::tuple<int, int>> SearchEngine<Evaluator, MoveOrderer>::Decide(const Logic& state)
+    {
+        StopPondering();
+        auto pondered = PonderResults.find(state.GetHash());
+        if (pondered != PonderResults.end())
+        {
+            const auto& best_move = pondered->second.MoveScores[0];
+            if (state.CanMakeMove(best_move.X, best_move.Y))
+            {
+                auto result = std::make_tuple(best_move.X, best_move.Y);
+                // The next search continues from the pondered search, not from the search before it
+                LastRootSearch = std::move(pondered->second);
+                PonderResults.clear();
+                return result;
+            }
+        }
+        PonderResults.clear();
+        auto analysis = SearchRoot(state, 1, LastRootSearch, &LastStatistics);
+        if (LogStatistics)
+            std::cout << "Search: " << LastStatistics.ToString() << std::endl;
+        if (analysis.size() == 0)
+            return std::optional<std::tuple<int, int>>();
+        return std::make_tuple(analysis[0].X, analysis[0].Y);
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    void SearchEngine<Evaluator, MoveOrderer>::Ponder(const Logic& state)
+    {
+        if (state.GetCurrentTurn() == Side::None || state.IsGameOver())
+            return;
+        if (NodeBudget > 0)
+            return; // The transposition table would depend on the thinking time of the other player
+        if (IsPondering && PonderedStateHash == state.GetHash())
+            return; // Already pondering or pondered
+        StopPondering();
+        PonderResults.clear();
+        PonderedStateHash = state.GetHash();
+        IsPondering = true;
+        PonderTask.Run([this, state]() { PonderReplies(state); });
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    void SearchEngine<Evaluator, MoveOrderer>::StopPondering()
+    {
+        if (!IsPondering)
+            return;
+        StopRequested = true;
+        PonderTask.Wait();
+        StopRequested = false;
+        IsPondering = false;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    int SearchEngine<Evaluator, MoveOrderer>::GetDepth()
+    {
+        return Depth;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    void SearchEngine<Evaluator, MoveOrderer>::SetDepth(int value)
+    {
+        StopPondering();
+        PonderResults.clear();
+        Depth = value;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    long long SearchEngine<Evaluator, MoveOrderer>::GetNodeBudget()
+    {
+        return NodeBudget;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    void SearchEngine<Evaluator, MoveOrderer>::SetNodeBudget(long long value)
+    {
+        StopPondering();
+        PonderResults.clear();
+        NodeBudget = value;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    std::vector<SearchEngineTypes::MoveAnalysis> SearchEngine<Evaluator, MoveOrderer>::Analyze(const Logic& state, int count)
+    {
+        StopPondering();
+        return SearchRoot(state, count, LastRootSearch, &LastStatistics);
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    SearchEngineTypes::SearchStatistics SearchEngine<Evaluator, MoveOrderer>::GetLastSearchStatistics()
+    {
+        return LastStatistics;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    void SearchEngine<Evaluator, MoveOrderer>::SetLogStatistics(bool value)
+    {
+        LogStatistics = value;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    std::vector<SearchEngineTypes::MoveAnalysis> SearchEngine<Evaluator, MoveOrderer>::SearchRoot(const Logic& state, int count, RootSearch& root_search,
+        SearchStatistics* statistics)
+    {
+        std::vector<MoveAnalysis> root_moves;
+        if (state.GetCurrentTurn() == Side::None || state.IsGameOver())
+            return root_moves;
+        auto& counters = search_engine_counters;
+        counters = SearchEngineCounters {};
+        search_engine_evaluation_cache_salt = EvaluationCacheSalt;
+        auto start_time = std::chrono::steady_clock::now();
+        std::vector<double> iteration_seconds;
+        /// @brief The node counts of the last two iterations.
+        long long iteration_nodes[2] = { 0, 0 };
+        Side side = state.GetCurrentTurn();
+        auto hash = state.GetHash();
+        int max_depth = Depth;
+        if (NodeBudget > 0)
+        {
+            // Deepen until the budget runs out, up to the end of the game
+            max_depth = -1;
+            for (int x = 0; x < 8; x++)
+                for (int y = 0; y < 8; y++)
+                    if (state.Get(x, y) == Side::None)
+                        max_depth++;
+        }
+        /// @brief The depth of the last completed iteration.
+        int completed_depth = 0;
+
+        if (hash == root_search.Hash)
+        {
+            // Same root as the last search, its scores are the best ordering there is
+            root_moves = root_search.MoveScores;
+        }
+        else
+        {
+            for (int x = 0; x < 8; x++)
+                for (int y = 0; y < 8; y++)
+                    if (state.CanMakeMove(x, y))
+                        root_moves.push_back(MoveAnalysis { x, y, MIN_SCORE, Bound::Upper });
+            // The state may be a descendant of the last search's root through its principal variation
+            for (int i = 0; i + 1 < root_search.PrincipalVariation.size(); i++)
+            {
+                if (root_search.PrincipalVariationHashes[i] == hash)
+                {
+                    auto [pv_x, pv_y] = root_search.PrincipalVariation[i + 1];
+                    auto pv_move = std::find_if(root_moves.begin(), root_moves.end(),
+                        [&](const auto& move) { return move.X == pv_x && move.Y == pv_y; });
+                    if (pv_move != root_moves.end())
+                        std::rotate(root_moves.begin(), pv_move, pv_move + 1);
+                    break;
+                }
+            }
+        }
+
+        // Iterative deepening, each iteration orders the root moves for the next one
+        // and fills the transposition table with the best moves of the inner nodes.
+        for (int depth = 0; depth <= max_depth; depth++)
+        {
+            auto iteration_start_time = std::chrono::steady_clock::now();
+            long long iteration_start_nodes = counters.Nodes;
+            auto last_root_moves = root_moves;
+            /// @brief The exact scores found in this iteration, best first, at most count of them.
+            std::vector<int> best_scores;
+            for (auto& move : root_moves)
+            {
+                auto new_state = state;
+                new_state.MakeMove(move.X, move.Y);
+                // Once there are enough exact scores, only a better move needs one.
+                // The others fail low on a null window and are left with an upper bound.
+                int alpha = count > 0 && best_scores.size() >= count ? best_scores.back() : MIN_SCORE;
+                if (alpha == MIN_SCORE)
+                {
+                    move.Score = CalculateScore(new_state, side, depth, alpha, MAX_SCORE);
+                }
+                else
+                {
+                    move.Score = CalculateScore(new_state, side, depth, alpha, alpha + 1);
+                    if (move.Score > alpha)
+                        move.Score = CalculateScore(new_state, side, depth, alpha, MAX_SCORE);
+                }
+                if (move.Score <= alpha)
+                {
+                    move.ScoreBound = Bound::Upper;
+                }
+                else
+                {
+                    move.ScoreBound = Bound::Exact;
+                    best_scores.insert(std::upper_bound(best_scores.begin(), best_scores.end(), move.Score, std::greater<int>()), move.Score);
+                    if (count > 0 && best_scores.size() > count)
+                        best_scores.pop_back();
+                }
+            }
+            if (StopRequested)
+                return std::vector<MoveAnalysis>();
+            if (depth > 0 && IsOutOfNodeBudget())
+            {
+                // The iteration is incomplete, the last complete one decides
+                root_moves = last_root_moves;
+                break;
+            }
+            completed_depth = depth;
+            iteration_seconds.push_back(((std::chrono::duration<double>)(std::chrono::steady_clock::now() - iteration_start_time)).count());
+            iteration_nodes[0] = iteration_nodes[1];
+            iteration_nodes[1] = counters.Nodes - iteration_start_nodes;
+            std::stable_sort(root_moves.begin(), root_moves.end(),
+                [](const MoveAnalysis& a, const MoveAnalysis& b)
+                {
+                    return a.Score > b.Score
+                        || (a.Score == b.Score && a.ScoreBound == Bound::Exact && b.ScoreBound != Bound::Exact);
+                });
+        }
+        if (root_moves.size() == 0)
+            return root_moves;
+        for (auto& move : root_moves)
+            move.PrincipalVariation = GetPrincipalVariation(state, move.X, move.Y, completed_depth);
+
+        // Keep the search results for the next searches
+        auto& entry = TranspositionEntryAt(hash);
+        entry.Hash = hash;
+        entry.Score = root_moves[0].Score;
+        entry.Depth = completed_depth + 1;
+        entry.ScoreBound = Bound::Exact;
+        entry.ScoreSide = side;
+        entry.BestX = root_moves[0].X;
+        entry.BestY = root_moves[0].Y;
+        root_search.Hash = hash;
+        root_search.MoveScores = root_moves;
+        root_search.PrincipalVariation = root_moves[0].PrincipalVariation;
+        root_search.PrincipalVariationHashes.clear();
+        Logic pv_state = state;
+        for (const auto& [x, y] : root_search.PrincipalVariation)
+        {
+            pv_state.MakeMove(x, y);
+            root_search.PrincipalVariationHashes.push_back(pv_state.GetHash());
+        }
+
+        if (statistics != nullptr)
+        {
+            statistics->Nodes = counters.Nodes;
+            statistics->Leaves = counters.Leaves;
+            statistics->Seconds = ((std::chrono::duration<double>)(std::chrono::steady_clock::now() - start_time)).count();
+            statistics->NodesPerSecond = statistics->Seconds > 0 ? counters.Nodes / statistics->Seconds : 0;
+            statistics->FirstMoveCutoffRate = counters.Cutoffs > 0 ? (double)counters.FirstMoveCutoffs / counters.Cutoffs : 0;
+            statistics->EffectiveBranchingFactor = iteration_nodes[0] > 0 ? (double)iteration_nodes[1] / iteration_nodes[0] : 0;
+            statistics->DepthReached = completed_depth + 1;
+            statistics->TranspositionProbes = counters.TranspositionProbes;
+            statistics->TranspositionHitRate = counters.TranspositionProbes > 0 ?
+                (double)counters.TranspositionHits / counters.TranspositionProbes : 0;
+            statistics->TranspositionCollisionRate = counters.TranspositionProbes > 0 ?
+                (double)counters.TranspositionCollisions / counters.TranspositionProbes : 0;
+            statistics->IterationSeconds = iteration_seconds;
+        }
+        return root_moves;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    std::vector<std::tuple<int, int>> SearchEngine<Evaluator, MoveOrderer>::GetPrincipalVariation(Logic state, int x, int y, int depth)
+    {
+        std::vector<std::tuple<int, int>> result;
+        result.push_back(std::make_tuple(x, y));
+        state.MakeMove(x, y);
+        while (result.size() <= depth)
+        {
+            auto& entry = TranspositionEntryAt(state.GetHash());
+            if (entry.Hash != state.GetHash() || entry.BestX < 0
+                || !state.CanMakeMove(entry.BestX, entry.BestY))
+                break;
+            result.push_back(std::make_tuple((int)entry.BestX, (int)entry.BestY));
+            state.MakeMove(entry.BestX, entry.BestY);
+        }
+        return result;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    void SearchEngine<Evaluator, MoveOrderer>::PonderReplies(Logic state)
+    {
+        Side ai_side = state.GetCurrentTurn() == Side::Black ? Side::White : Side::Black;
+        /// @brief (The AI's shallow score, reply state) tuples. The lower the score, the more likely the reply.
+        std::vector<std::tuple<int, Logic>> replies;
+        for (int x = 0; x < 8; x++)
+        {
+            for (int y = 0; y < 8; y++)
+            {
+                if (state.CanMakeMove(x, y))
+                {
+                    auto new_state = state;
+                    new_state.MakeMove(x, y);
+                    if (new_state.GetCurrentTurn() == ai_side)
+                        replies.push_back(std::make_tuple(CalculateScoreTerminal(new_state, ai_side), new_state));
+                }
+            }
+        }
+        std::stable_sort(replies.begin(), replies.end(),
+            [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+        for (const auto& [shallow_score, reply_state] : replies)
+        {
+            // Each reply is seeded from the search that pondering started after, which expects one of them.
+            // LastRootSearch isn't changed until pondering is stopped.
+            RootSearch reply_search = LastRootSearch;
+            auto analysis = SearchRoot(reply_state, 1, reply_search, nullptr);
+            if (StopRequested)
+                return;
+            if (analysis.size() > 0)
+                PonderResults[reply_state.GetHash()] = std::move(reply_search);
+        }
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    typename SearchEngine<Evaluator, MoveOrderer>::TranspositionEntry& SearchEngine<Evaluator, MoveOrderer>::TranspositionEntryAt(unsigned long long hash)
+    {
+        return TranspositionTable[hash & (SEARCH_ENGINE_TRANSPOSITION_TABLE_SIZE - 1)];
+    }
+
+    constexpr static int SEARCH_ENGINE_LEAF_SEARCH_DEPTH = 3;
+
+    /// @brief Leaf evaluations from the side to move's point of view, one cache per evaluator type.
+    ///        2^15 entries of 8 bytes, 256 KiB.
+    template <typename Evaluator>
+    inline EvaluationCache<int, 15>& get_search_engine_evaluation_cache()
+    {
+        // A function-local variable, since GCC doesn't initialize thread_local variable templates
+        thread_local EvaluationCache<int, 15> cache;
+        return cache;
+    }
+
+    /// @brief SearchEngine::CalculateScoreTerminal for a BitBoard.
+    /// @tparam maximize Whether the side to move is the side that the score is calculated for.
+    template <typename Evaluator, bool maximize>
+    inline int calculate_leaf_score_terminal(const Evaluator& evaluator, const BitBoard& board, bool is_game_over)
+    {
+        int win_points = maximize ? board.GetPlayerCount() : board.GetOpponentCount();
+        int lose_points = maximize ? board.GetOpponentCount() : board.GetPlayerCount();
+        search_engine_counters.Leaves++;
+        if (is_game_over)
+            return (win_points - lose_points) * SearchEngineTypes::DISC_SCORE;
+        int score;
+        auto hash = board.GetHash() ^ search_engine_evaluation_cache_salt;
+        auto& cache = get_search_engine_evaluation_cache<Evaluator>();
+        if (!cache.Get(hash, score))
+        {
+            score = evaluator.Evaluate(board);
+            cache.Set(hash, score);
+        }
+        return maximize ? score : -score;
+    }
+
+    /// @brief SearchEngine::CalculateScore for the last plies, unrolled at compile time.
+    ///
+    /// Near the leaves, move ordering and the transposition table cost more than they save, so they're skipped.
+    /// @tparam maximize Whether the side to move is the side that the score is calculated for.
+    /// @param moves The legal moves of the board, not 0.
+    template <typename Evaluator, int depth, bool maximize>
+    int calculate_leaf_score(const Evaluator& evaluator, const BitBoard& board, unsigned long long moves, int alpha, int beta)
+    {
+        search_engine_counters.Nodes++;
+        if constexpr (depth <= 0)
+        {
+            return calculate_leaf_score_terminal<Evaluator, maximize>(evaluator, board, false);
+        }
+        else
+        {
+            int score = maximize ? MIN_SCORE : MAX_SCORE;
+            bool is_first_move = true;
+            while (moves != 0)
+            {
+                int index = std::countr_zero(moves);
+                moves &= moves - 1;
+                BitBoard new_board = board;
+                new_board.MakeMove(index, board.GetFlips(index));
+                unsigned long long new_moves = new_board.GetMoves();
+                int local_score;
+                if (new_moves != 0)
+                {
+                    local_score = calculate_leaf_score<Evaluator, depth - 1, !maximize>(evaluator, new_board, new_moves, alpha, beta);
+                }
+                else
+                {
+                    // The other side can't move, so it's the same side's turn again, as Logic does
+                    new_board.Pass();
+                    new_moves = new_board.GetMoves();
+                    if (new_moves != 0)
+                        local_score = calculate_leaf_score<Evaluator, depth - 1, maximize>(evaluator, new_board, new_moves, alpha, beta);
+                    else
+                        local_score = calculate_leaf_score_terminal<Evaluator, maximize>(evaluator, new_board, true);
+                }
+                if (maximize && local_score > score)
+                {
+                    score = local_score;
+                    if (score > alpha)
+                        alpha = score;
+                }
+                else if (!maximize && local_score < score)
+                {
+                    score = local_score;
+                    if (score < beta)
+                        beta = score;
+                }
+                if (alpha >= beta)
+                {
+                    search_engine_counters.Cutoffs++;
+                    if (is_first_move)
+                        search_engine_counters.FirstMoveCutoffs++;
+                    break;
+                }
+                is_first_move = false;
+            }
+            return score;
+        }
+    }
+
+    template <typename Evaluator, bool maximize>
+    int calculate_leaf_score(const Evaluator& evaluator, const BitBoard& board, unsigned long long moves, int depth, int alpha, int beta)
+    {
+        static_assert(SEARCH_ENGINE_LEAF_SEARCH_DEPTH == 3);
+        switch (depth)
+        {
+        case 1:
+            return calculate_leaf_score<Evaluator, 1, maximize>(evaluator, board, moves, alpha, beta);
+        case 2:
+            return calculate_leaf_score<Evaluator, 2, maximize>(evaluator, board, moves, alpha, beta);
+        case 3:
+            return calculate_leaf_score<Evaluator, 3, maximize>(evaluator, board, moves, alpha, beta);
+        default:
+            throw std::logic_error("Leaf search depth out of range.");
+        }
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    inline bool SearchEngine<Evaluator, MoveOrderer>::IsOutOfNodeBudget()
+    {
+        return NodeBudget > 0 && search_engine_counters.Nodes >= NodeBudget;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    int SearchEngine<Evaluator, MoveOrderer>::CalculateScore(const Logic& state, Side side, int depth, int alpha, int beta)
+    {
+        if (StopRequested.load(std::memory_order_relaxed))
+            return MIN_SCORE; // The result is discarded
+        if (depth <= 0 || state.IsGameOver())
+        {
+            search_engine_counters.Nodes++;
+            return CalculateScoreTerminal(state, side);
+        }
+        if (IsOutOfNodeBudget())
+            return MIN_SCORE; // The result is discarded
+        if (depth <= SEARCH_ENGINE_LEAF_SEARCH_DEPTH)
+        {
+            auto board = BitBoard::FromLogic(state, state.GetCurrentTurn());
+            if (state.GetCurrentTurn() == side)
+                return calculate_leaf_score<Evaluator, true>(LeafEvaluator, board, board.GetMoves(), depth, alpha, beta);
+            else
+                return calculate_leaf_score<Evaluator, false>(LeafEvaluator, board, board.GetMoves(), depth, alpha, beta);
+        }
+        auto& counters = search_engine_counters;
+        counters.Nodes++;
+        counters.TranspositionProbes++;
+        auto hash = state.GetHash();
+        auto& entry = TranspositionEntryAt(hash);
+        int tt_move_x = -1;
+        int tt_move_y = -1;
+        if (entry.Hash != hash && entry.Depth >= 0)
+            counters.TranspositionCollisions++;
+        if (entry.Hash == hash)
+        {
+            counters.TranspositionHits++;
+            if (entry.ScoreSide == side && entry.Depth >= depth
+                && (entry.ScoreBound == Bound::Exact
+                    || (entry.ScoreBound == Bound::Lower && entry.Score >= beta)
+                    || (entry.ScoreBound == Bound::Upper && entry.Score <= alpha)))
+                return entry.Score;
+            // The best move doesn't depend on the side that the score is calculated for
+            tt_move_x = entry.BestX;
+            tt_move_y = entry.BestY;
+        }
+        /// @brief (x, y) of the moves, the best move of the transposition table first, then the others as MoveOrderer orders.
+        std::tuple<int, int> moves[64];
+        int count = 0;
+        for (int x = 0; x < 8; x++)
+        {
+            for (int y = 0; y < 8; y++)
+            {
+                if (state.CanMakeMove(x, y))
+                {
+                    moves[count] = std::make_tuple(x, y);
+                    if (x == tt_move_x && y == tt_move_y)
+                        std::swap(moves[0], moves[count]);
+                    count++;
+                }
+            }
+        }
+        if (count == 0)
+            return CalculateScoreTerminal(state, side);
+        int ordered_moves_start = moves[0] == std::make_tuple(tt_move_x, tt_move_y) ? 1 : 0;
+        Orderer.Order(state, moves + ordered_moves_start, count - ordered_moves_start);
+        int original_alpha = alpha;
+        int original_beta = beta;
+        bool should_maximize_score = state.GetCurrentTurn() == side;
+        int score = should_maximize_score ? MIN_SCORE : MAX_SCORE;
+        int best_x = -1;
+        int best_y = -1;
+        for (int i = 0; i < count && alpha < beta; i++)
+        {
+            auto [x, y] = moves[i];
+            auto new_state = state;
+            new_state.MakeMove(x, y);
+            int local_score;
+            if (i == 0)
+            {
+                local_score = CalculateScore(new_state, side, depth - 1, alpha, beta);
+            }
+            else
+            {
+                // Principal variation search: the first move is expected to be the best,
+                // so the others are only tested against it on a null window and re-searched if better.
+                if (should_maximize_score)
+                    local_score = CalculateScore(new_state, side, depth - 1, alpha, alpha + 1);
+                else
+                    local_score = CalculateScore(new_state, side, depth - 1, beta - 1, beta);
+                if (alpha < local_score && local_score < beta)
+                    local_score = CalculateScore(new_state, side, depth - 1, alpha, beta);
+            }
+            if (should_maximize_score && local_score > score)
+            {
+                score = local_score;
+                best_x = x;
+                best_y = y;
+                if (score > alpha)
+                    alpha = score;
+            }
+            else if (!should_maximize_score && local_score < score)
+            {
+                score = local_score;
+                best_x = x;
+                best_y = y;
+                if (score < beta)
+                    beta = score;
+            }
+            if (alpha >= beta)
+            {
+                counters.Cutoffs++;
+                if (i == 0)
+                    counters.FirstMoveCutoffs++;
+            }
+        }
+        if (StopRequested.load(std::memory_order_relaxed) || IsOutOfNodeBudget())
+            return score; // Incomplete, not stored
+        // The children may have replaced the entry, so it's checked again.
+        if (entry.Hash != hash || entry.Depth <= depth)
+        {
+            entry.Hash = hash;
+            entry.Score = score;
+            entry.Depth = depth;
+            entry.ScoreBound = score <= original_alpha ? Bound::Upper : (score >= original_beta ? Bound::Lower : Bound::Exact);
+            entry.ScoreSide = side;
+            entry.BestX = best_x;
+            entry.BestY = best_y;
+        }
+        return score;
+    }
+
+    template <typename Evaluator, typename MoveOrderer>
+    int SearchEngine<Evaluator, MoveOrderer>::CalculateScoreTerminal(const Logic& state, Side side)
+    {
+        search_engine_counters.Leaves++;
+        auto board = BitBoard::FromLogic(state, side);
+        if (state.IsGameOver())
+            return (board.GetPlayerCount() - board.GetOpponentCount()) * DISC_SCORE;
+        return LeafEvaluator.Evaluate(board);
+    }
+}
@@ -0,0 +1,143 @@
+#include "TDLearner.h"
+
+#include "Logic.h"
+
+#include <bit>
+#include <cmath>
+
+namespace Reversi
+{
+    /// @brief The predictions are logits of the expected result, the same scale as the tuner fits.
+    constexpr float TD_LEARNER_LOGIT_SCALE = 32;
+    /// @brief The eligibility of the older plies is negligible, so they're not updated.
+    constexpr float TD_LEARNER_MIN_TRACE = 1e-3f;
+
+    TDLearner::TDLearner(std::shared_ptr<PatternWeights> Weights, float LearningRate, float Lambda) :
+        Weights(Weights),
+        LearningRate(LearningRate),
+        Lambda(Lambda),
+        LastValue(0.5f)
+    {
+        TraceFeatures.reserve(64 * PatternWeights::FEATURES_COUNT);
+        TraceGradients.reserve(64);
+    }
+
+    void TDLearner::StartGame()
+    {
+        TraceFeatures.clear();
+        TraceGradients.clear();
+        LastValue = 0.5f;
+    }
+
+    void TDLearner::Observe(const BitBoard& board, bool is_black_to_move)
+    {
+        std::size_t ply_features = TraceFeatures.size();
+        TraceFeatures.resize(ply_features + PatternWeights::FEATURES_COUNT);
+        int* features = TraceFeatures.data() + ply_features;
+        PatternWeights::GetFeatures(board, features);
+        const float* weight_values = Weights->GetWeights();
+        float prediction = 0;
+        for (int i = 0; i < PatternWeights::FEATURES_COUNT; i++)
+            prediction += weight_values[features[i]];
+        float probability = 1 / (1 + std::exp(-prediction / TD_LEARNER_LOGIT_SCALE));
+        float value = is_black_to_move ? probability : 1 - probability;
+
+        // The traces of the earlier plies learn from this one, then this ply joins them
+        if (!TraceGradients.empty())
+            Update(value - LastValue);
+        float gradient = probability * (1 - probability) / TD_LEARNER_LOGIT_SCALE;
+        TraceGradients.push_back(is_black_to_move ? gradient : -gradient);
+        LastValue = value;
+    }
+
+    void TDLearner::EndGame(int black_disc_differential)
+    {
+        if (!TraceGradients.empty())
+            Update((black_disc_differential + 64) / 128.0f - LastValue);
+        TraceFeatures.clear();
+        TraceGradients.clear();
+    }
+
+    void TDLearner::Update(float td_error)
+    {
+        float* weight_values = Weights->GetWeights();
+        float trace = 1;
+        for (int ply = (int)TraceGradients.size() - 1; ply >= 0 && trace >= TD_LEARNER_MIN_TRACE; ply--)
+        {
+            float step = LearningRate * td_error * trace * TraceGradients[ply];
+            const int* features = TraceFeatures.data() + ply * PatternWeights::FEATURES_COUNT;
+            for (int i = 0; i < PatternWeights::FEATURES_COUNT; i++)
+                weight_values[features[i]] += step;
+            trace *= Lambda;
+        }
+    }
+
+    float TDLearner::GetValue(const BitBoard& board)
+    {
+        return 1 / (1 + std::exp(-Weights->Predict(board) / TD_LEARNER_LOGIT_SCALE));
+    }
+
+    int TDLearner::PlaySelfPlayGame(std::mt19937& random, float exploration)
+    {
+        StartGame();
+        BitBoard board = BitBoard::FromLogic(Logic(), Side::Black);
+        bool is_black_to_move = true;
+        int positions_count = 0;
+        while (true)
+        {
+            Observe(board, is_black_to_move);
+            positions_count++;
+
+            unsigned long long moves = board.GetMoves();
+            int move = -1;
+            if (std::uniform_real_distribution<float>(0, 1)(random) < exploration)
+            {
+                for (int skipped = std::uniform_int_distribution<int>(0, std::popcount(moves) - 1)(random); skipped > 0; skipped--)
+                    moves &= moves - 1;
+                move = std::countr_zero(moves);
+            }
+            else
+            {
+                float best_value = -1;
+                for (; moves; moves &= moves - 1)
+                {
+                    int index = std::countr_zero(moves);
+                    BitBoard next = board;
+                    next.MakeMove(index, next.GetFlips(index));
+                    // The value for the side making the move
+                    float value;
+                    if (next.GetMoves())
+                    {
+                        value = 1 - GetValue(next);
+                    }
+                    else
+                    {
+                        next.Pass();
+                        if (next.GetMoves())
+                            value = GetValue(next);
+                        else
+                            value = (next.GetPlayerCount() - next.GetOpponentCount() + 64) / 128.0f;
+                    }
+                    if (value > best_value)
+                    {
+                        best_value = value;
+                        move = index;
+                    }
+                }
+            }
+
+            board.MakeMove(move, board.GetFlips(move));
+            is_black_to_move = !is_black_to_move;
+            if (board.GetMoves() == 0)
+            {
+                board.Pass();
+                is_black_to_move = !is_black_to_move;
+                if (board.GetMoves() == 0)
+                    break;
+            }
+        }
+        int differential = board.GetPlayerCount() - board.GetOpponentCount();
+        EndGame(is_black_to_move ? differential : -differential);
+        return positions_count;
+    }
+}
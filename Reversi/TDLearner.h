@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include "BitBoard.h"
+#include "PatternEvaluator.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace Reversi
+{
+    /// @brief Learns PatternWeights by TD(lambda), updating the weights after every ply of a game.
+    ///
+    /// The values are the expected results for Black in range [0, 1], the sigmoid of the scaled prediction.
+    /// The eligibility traces are kept as the features and the gradient of each ply in flat arrays,
+    /// since each ply only touches PatternWeights::FEATURES_COUNT weights.
+    class TDLearner final
+    {
+    public:
+        /// @param LearningRate The step size in prediction units (discs) per unit of TD error.
+        /// @param Lambda In range [0, 1]. 0: learn each position from the next one only, 1: from the game result only.
+        TDLearner(std::shared_ptr<PatternWeights> Weights, float LearningRate = 64, float Lambda = 0.7f);
+
+        /// @brief Forgets the positions of the last game.
+        void StartGame();
+        /// @brief Learns from the step to the position, which is not game over.
+        /// @param board From the point of view of the side to move.
+        void Observe(const BitBoard& board, bool is_black_to_move);
+        /// @brief Learns from the step to the game over position.
+        void EndGame(int black_disc_differential);
+        /// @brief Plays a game against itself, learning after every ply.
+        ///
+        /// Each move is the best one by the current weights with one ply lookahead, or a random one by the exploration chance.
+        /// @return The number of positions learned from.
+        int PlaySelfPlayGame(std::mt19937& random, float exploration);
+    private:
+        std::shared_ptr<PatternWeights> Weights;
+        float LearningRate;
+        float Lambda;
+        /// @brief PatternWeights::FEATURES_COUNT weight indices for each observed ply.
+        std::vector<int> TraceFeatures;
+        /// @brief The gradient of the value for Black by each feature weight, for each observed ply.
+        std::vector<float> TraceGradients;
+        /// @brief The value of the last observed position for Black.
+        float LastValue;
+
+        /// @brief Adds the TD error times the eligibility trace to the weights.
+        void Update(float td_error);
+        /// @return The value of the board for its side to move, in range [0, 1].
+        float GetValue(const BitBoard& board);
+    };
+}
@@ -0,0 +1,305 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Reversi
+{
+    constexpr static std::size_t SCRATCH_ARENA_BLOCK_SIZE = 1 << 16;
+
+    ScratchArena::ScratchArena() : BlockIndex(0), Offset(0)
+    {
+    }
+
+    void* ScratchArena::Allocate(std::size_t size, std::size_t alignment)
+    {
+        while (true)
+        {
+            if (BlockIndex < Blocks.size())
+            {
+                auto& block = Blocks[BlockIndex];
+                std::size_t address = (std::size_t)block.Data.get() + Offset;
+                std::size_t padding = (alignment - address % alignment) % alignment;
+                if (Offset + padding + size <= block.Size)
+                {
+                    Offset += padding + size;
+                    return block.Data.get() + Offset - size;
+                }
+                if (BlockIndex + 1 < Blocks.size())
+                {
+                    BlockIndex++;
+                    Offset = 0;
+                    continue;
+                }
+            }
+            // Out of blocks, the new block is big enough for the allocation
+            std::size_t block_size = std::max(SCRATCH_ARENA_BLOCK_SIZE, size + alignment);
+            Blocks.push_back(Block { std::unique_ptr<unsigned char[]>(new unsigned char[block_size]), block_size });
+            BlockIndex = Blocks.size() - 1;
+            Offset = 0;
+        }
+    }
+
+    ScratchArena::Mark ScratchArena::GetMark() const
+    {
+        return Mark { BlockIndex, Offset };
+    }
+
+    void ScratchArena::Rewind(Mark mark)
+    {
+        BlockIndex = mark.BlockIndex;
+        Offset = mark.Offset;
+    }
+
+    thread_local ScratchArena thread_pool_scratch_arena;
+    /// @brief The worker index of the calling thread in its pool, -1 if it's not a worker.
+    thread_local int thread_pool_worker_index = -1;
+    thread_local ThreadPool* thread_pool_worker_pool = nullptr;
+
+    std::mutex thread_pool_shared_mutex;
+    int thread_pool_shared_threads_count = 0;
+    bool thread_pool_shared_pin_threads = false;
+    /// @brief Whether GetShared has created the shared pool, which can't be configured then.
+    bool thread_pool_shared_is_created = false;
+
+    ThreadPool::ThreadPool(int ThreadsCount, bool PinThreads) : QueuedCount(0), NextWorker(0), Stopping(false)
+    {
+        int cores_count = std::thread::hardware_concurrency();
+#ifdef __linux__
+        /// @brief The cores that the process can run on, which may be fewer than the cores of the machine.
+        std::vector<int> cores;
+        cpu_set_t allowed_cpu_set;
+        if (sched_getaffinity(0, sizeof(allowed_cpu_set), &allowed_cpu_set) == 0)
+        {
+            for (int i = 0; i < CPU_SETSIZE; i++)
+                if (CPU_ISSET(i, &allowed_cpu_set))
+                    cores.push_back(i);
+            cores_count = cores.size();
+        }
+        else if (PinThreads)
+        {
+            throw std::runtime_error("Can't get the cores to pin the thread pool workers to.");
+        }
+#endif
+        if (ThreadsCount <= 0)
+            ThreadsCount = std::max(1, cores_count - 1);
+        for (int i = 0; i < ThreadsCount; i++)
+            Workers.push_back(std::make_unique<Worker>());
+        // The workers start after all of them exist, as they steal from each other
+        for (int i = 0; i < ThreadsCount; i++)
+            Workers[i]->Thread = std::thread(&ThreadPool::RunWorker, this, i);
+#ifdef __linux__
+        if (PinThreads)
+        {
+            for (int i = 0; i < ThreadsCount; i++)
+            {
+                // With more workers than cores, the cores are shared in turn
+                cpu_set_t cpu_set;
+                CPU_ZERO(&cpu_set);
+                CPU_SET(cores[i % cores.size()], &cpu_set);
+                if (pthread_setaffinity_np(Workers[i]->Thread.native_handle(), sizeof(cpu_set), &cpu_set) != 0)
+                {
+                    Stop();
+                    throw std::runtime_error("Can't pin a thread pool worker to core " + std::to_string(cores[i % cores.size()]) + ".");
+                }
+            }
+        }
+#endif
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Stop();
+    }
+
+    ThreadPool& ThreadPool::GetShared()
+    {
+        static std::unique_ptr<ThreadPool> shared = []()
+        {
+            std::lock_guard<std::mutex> lock(thread_pool_shared_mutex);
+            thread_pool_shared_is_created = true;
+            return std::make_unique<ThreadPool>(thread_pool_shared_threads_count, thread_pool_shared_pin_threads);
+        }();
+        return *shared;
+    }
+
+    void ThreadPool::ConfigureShared(int threads_count, bool pin_threads)
+    {
+        std::lock_guard<std::mutex> lock(thread_pool_shared_mutex);
+        if (thread_pool_shared_is_created)
+            throw std::logic_error("The shared thread pool is already created.");
+        thread_pool_shared_threads_count = threads_count;
+        thread_pool_shared_pin_threads = pin_threads;
+    }
+
+    ScratchArena& ThreadPool::GetScratchArena()
+    {
+        return thread_pool_scratch_arena;
+    }
+
+    int ThreadPool::GetThreadsCount()
+    {
+        return Workers.size();
+    }
+
+    void ThreadPool::Submit(std::shared_ptr<Task> task, TaskPriority priority)
+    {
+        // A worker keeps its tasks, the others spread theirs
+        int index = thread_pool_worker_pool == this ? thread_pool_worker_index : NextWorker++ % Workers.size();
+        {
+            std::lock_guard<std::mutex> lock(Workers[index]->Mutex);
+            Workers[index]->Queues[(int)priority].push_back(task);
+        }
+        {
+            std::lock_guard<std::mutex> lock(SleepMutex);
+            QueuedCount++;
+        }
+        WakeUp.notify_one();
+    }
+
+    void ThreadPool::RunWorker(int index)
+    {
+        thread_pool_worker_index = index;
+        thread_pool_worker_pool = this;
+        while (true)
+        {
+            auto task = TakeTask(index);
+            if (task != nullptr)
+            {
+                Execute(*task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(SleepMutex);
+            WakeUp.wait(lock, [this]() { return QueuedCount > 0 || Stopping; });
+            if (Stopping)
+                return;
+        }
+    }
+
+    void ThreadPool::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(SleepMutex);
+            Stopping = true;
+        }
+        WakeUp.notify_all();
+        for (auto& worker : Workers)
+            if (worker->Thread.joinable())
+                worker->Thread.join();
+    }
+
+    std::shared_ptr<ThreadPool::Task> ThreadPool::TakeTask(int index)
+    {
+        for (int priority = 0; priority < 2; priority++)
+        {
+            for (std::size_t i = 0; i < Workers.size(); i++)
+            {
+                auto& worker = *Workers[(index + i) % Workers.size()];
+                std::lock_guard<std::mutex> lock(worker.Mutex);
+                auto& queue = worker.Queues[priority];
+                if (queue.empty())
+                    continue;
+                std::shared_ptr<Task> task;
+                if (i == 0)
+                {
+                    // The newest task of its own is likely still in the cache
+                    task = queue.back();
+                    queue.pop_back();
+                }
+                else
+                {
+                    task = queue.front();
+                    queue.pop_front();
+                }
+                QueuedCount--;
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void ThreadPool::Execute(Task& task)
+    {
+        if (task.Claimed.exchange(true))
+            return; // Run by the thread waiting for the group, which may not exist anymore
+        auto& arena = thread_pool_scratch_arena;
+        auto mark = arena.GetMark();
+        std::exception_ptr exception;
+        try
+        {
+            task.Function();
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+        arena.Rewind(mark);
+        task.Group->Finish(exception);
+    }
+
+    TaskGroup::TaskGroup(TaskPriority priority, ThreadPool& pool) : Pool(pool), Priority(priority), PendingCount(0)
+    {
+    }
+
+    TaskGroup::~TaskGroup()
+    {
+        try
+        {
+            Wait();
+        }
+        catch (...)
+        {
+            // Nobody to report to
+        }
+    }
+
+    void TaskGroup::Run(std::function<void()> function)
+    {
+        auto task = std::make_shared<ThreadPool::Task>();
+        task->Function = std::move(function);
+        task->Group = this;
+        task->Claimed = false;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            PendingCount++;
+            Tasks.push_back(task);
+        }
+        Pool.Submit(task, Priority);
+    }
+
+    void TaskGroup::Wait()
+    {
+        std::vector<std::shared_ptr<ThreadPool::Task>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            tasks.swap(Tasks);
+        }
+        for (auto& task : tasks)
+            ThreadPool::Execute(*task);
+        std::unique_lock<std::mutex> lock(Mutex);
+        Done.wait(lock, [this]() { return PendingCount == 0; });
+        if (Exception != nullptr)
+        {
+            auto exception = Exception;
+            Exception = nullptr;
+            std::rethrow_exception(exception);
+        }
+    }
+
+    void TaskGroup::Finish(std::exception_ptr exception)
+    {
+        // Notified while locked, so that the group isn't destroyed by the waiting thread before it
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (exception != nullptr && Exception == nullptr)
+            Exception = exception;
+        PendingCount--;
+        if (PendingCount == 0)
+            Done.notify_all();
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "Reversi.dec.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Reversi
+{
+    enum class TaskPriority : char
+    {
+        /// @brief Work that a player is waiting for, like searching for a move.
+        Interactive = 0,
+        /// @brief Work that can wait, like learning and saving.
+        Background = 1
+    };
+
+    /// @brief Bump allocator for temporary memory of a task, one for each thread.
+    ///
+    /// The memory that a task allocates is released when the task is done.
+    class ScratchArena final
+    {
+    public:
+        /// @brief A position in the arena to rewind to.
+        struct Mark
+        {
+        public:
+            std::size_t BlockIndex;
+            std::size_t Offset;
+        };
+
+        ScratchArena();
+        ScratchArena(const ScratchArena&) = delete;
+        ScratchArena& operator=(const ScratchArena&) = delete;
+
+        /// @return Memory that is valid until the arena is rewound before it. It's not initialized.
+        void* Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+        /// @tparam T Should be trivially destructible, as no destructor is called.
+        template <typename T>
+        T* AllocateArray(std::size_t count);
+        Mark GetMark() const;
+        /// @brief Releases the memory allocated after the mark, keeping the blocks for reuse.
+        void Rewind(Mark);
+    private:
+        struct Block
+        {
+        public:
+            std::unique_ptr<unsigned char[]> Data;
+            std::size_t Size;
+        };
+
+        std::vector<Block> Blocks;
+        std::size_t BlockIndex;
+        std::size_t Offset;
+    };
+
+    /// @brief Process-wide pool of worker threads, so that the features running in parallel
+    ///        share the cores instead of each starting its own threads.
+    ///
+    /// Each worker has its own queues, runs its newest task first and steals the oldest tasks of the others.
+    /// All Interactive tasks are run before any Background task.
+    /// Tasks are submitted and waited through TaskGroup.
+    class ThreadPool final
+    {
+    public:
+        /// @param ThreadsCount The number of worker threads, 0 for one less than the number of cores the process can run on,
+        ///                     as the thread that waits for the tasks also runs them.
+        /// @param PinThreads Whether to pin each worker to one of the cores that the process can run on, in order,
+        ///                   only supported on Linux.
+        /// @throws std::runtime_error If the workers can't be pinned.
+        ThreadPool(int ThreadsCount = 0, bool PinThreads = false);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// @brief The pool of the process, created on the first call.
+        static ThreadPool& GetShared();
+        /// @brief Sets the parameters of the shared pool, see the constructor.
+        /// @throws std::logic_error If the shared pool is already created by GetShared.
+        static void ConfigureShared(int threads_count, bool pin_threads);
+        /// @brief The scratch arena of the calling thread.
+        static ScratchArena& GetScratchArena();
+        int GetThreadsCount();
+    private:
+        friend class TaskGroup;
+
+        struct Task
+        {
+        public:
+            std::function<void()> Function;
+            TaskGroup* Group;
+            /// @brief Set by the thread that runs the task, a worker or the thread waiting for the group.
+            std::atomic<bool> Claimed;
+        };
+
+        struct Worker
+        {
+        public:
+            std::mutex Mutex;
+            /// @brief A queue for each TaskPriority.
+            std::deque<std::shared_ptr<Task>> Queues[2];
+            std::thread Thread;
+        };
+
+        std::vector<std::unique_ptr<Worker>> Workers;
+        std::mutex SleepMutex;
+        std::condition_variable WakeUp;
+        /// @brief The tasks in the queues, including the claimed ones that are not removed yet.
+        std::atomic<int> QueuedCount;
+        std::atomic<unsigned int> NextWorker;
+        bool Stopping;
+
+        void Submit(std::shared_ptr<Task>, TaskPriority);
+        void RunWorker(int index);
+        /// @brief Stops and joins the workers.
+        void Stop();
+        /// @brief Takes a task, own queue first, then the others', in priority order.
+        std::shared_ptr<Task> TakeTask(int index);
+        /// @brief Runs the task if it's not claimed yet.
+        static void Execute(Task&);
+    };
+
+    /// @brief Tasks that are waited together.
+    ///
+    /// Wait runs the tasks that no worker has started on the calling thread,
+    /// so waiting never depends on the workers being free, and a task can wait for its own tasks.
+    class TaskGroup final
+    {
+    public:
+        TaskGroup(TaskPriority priority = TaskPriority::Interactive, ThreadPool& pool = ThreadPool::GetShared());
+        /// @brief Waits for the tasks.
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void Run(std::function<void()> function);
+        /// @brief Waits for the tasks run so far, and rethrows the first exception that they have thrown.
+        void Wait();
+    private:
+        friend class ThreadPool;
+
+        ThreadPool& Pool;
+        TaskPriority Priority;
+        std::mutex Mutex;
+        std::condition_variable Done;
+        int PendingCount;
+        std::vector<std::shared_ptr<ThreadPool::Task>> Tasks;
+        std::exception_ptr Exception;
+
+        /// @brief Called by ThreadPool after running a task of the group.
+        void Finish(std::exception_ptr exception);
+    };
+
+    template <typename T>
+    T* ScratchArena::AllocateArray(std::size_t count)
+    {
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    }
+}
@@ -0,0 +1,649 @@
+#include "AI.h"
+#include "BitBoard.h"
+#include "Logic.h"
+#include "NetworkEvaluator.h"
+#include "PatternEvaluator.h"
+#include "TDLearner.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Offline tool that tunes PatternWeights and trains NetworkWeights on positions labeled with the final disc differential.
+//
+// ReversiTuner generate <dataset file> <games count> [seed]
+//     Plays games between shallow searches with some random moves and writes their positions.
+// ReversiTuner tune <dataset file> <weights file> [epochs] [learning rate] [minibatch size]
+//     Fits the weights by minibatch gradient descent, starting from the weights file if it exists.
+// ReversiTuner trainnet <dataset file> <network file> [epochs] [learning rate] [minibatch size]
+//     Trains a NetworkWeights network in floats by Adam and saves it quantized.
+// ReversiTuner selfplay <weights file> <games count> [learning rate] [lambda] [exploration] [seed]
+//     Learns the weights by TD(lambda) from games against itself, starting from the weights file if it exists.
+//
+// The options of the shared thread pool come before the command:
+// --threads <count>
+//     The number of worker threads, which work with the main thread. One less than the available cores by default.
+// --pin
+//     Pins each worker thread to one of the available cores.
+
+namespace Reversi
+{
+    /// @brief A position and the final disc differential of its game for BitBoard::Player.
+    struct LabeledPosition
+    {
+    public:
+        BitBoard Board;
+        signed char DiscDifferential;
+    };
+
+    constexpr unsigned char DATASET_FILE_HEADER[] = {
+        0xFF,
+        'R','e','m','i','n','i','m','a','l','i','s','m','.','R','e','v','e','r','s','i','.','D','a','t','a','s','e','t',
+        0xFF
+    };
+    constexpr unsigned char DATASET_FILE_VERSION[] = { 0, 0, 0, 1 };
+
+    /// @brief The predictions are logits of the expected result, scaled so that a disc of prediction is about a disc of differential.
+    constexpr float TUNER_LOGIT_SCALE = 32;
+    constexpr int TUNER_GENERATION_SEARCH_DEPTH = 2;
+    /// @brief The chance of a random move instead of a searched one, to vary the positions.
+    constexpr float TUNER_GENERATION_RANDOM_MOVE_CHANCE = 0.1f;
+    /// @brief The fraction of the dataset that is kept out of training to measure the error.
+    constexpr float TUNER_VALIDATION_FRACTION = 0.05f;
+
+    /// @brief The offsets of the parameters of the network in a flat array, in the order of NetworkParameters.
+    constexpr int TUNER_NETWORK_FIRST_WEIGHTS = 0;
+    constexpr int TUNER_NETWORK_FIRST_BIASES = TUNER_NETWORK_FIRST_WEIGHTS + NetworkWeights::INPUTS_COUNT * NetworkWeights::FIRST_LAYER_SIZE;
+    constexpr int TUNER_NETWORK_SECOND_WEIGHTS = TUNER_NETWORK_FIRST_BIASES + NetworkWeights::FIRST_LAYER_SIZE;
+    constexpr int TUNER_NETWORK_SECOND_BIASES = TUNER_NETWORK_SECOND_WEIGHTS + NetworkWeights::SECOND_LAYER_SIZE * NetworkWeights::FIRST_LAYER_SIZE;
+    constexpr int TUNER_NETWORK_OUTPUT_WEIGHTS = TUNER_NETWORK_SECOND_BIASES + NetworkWeights::SECOND_LAYER_SIZE;
+    constexpr int TUNER_NETWORK_OUTPUT_BIAS = TUNER_NETWORK_OUTPUT_WEIGHTS + NetworkWeights::SECOND_LAYER_SIZE;
+    constexpr int TUNER_NETWORK_PARAMETERS_COUNT = TUNER_NETWORK_OUTPUT_BIAS + 1;
+    constexpr float TUNER_ADAM_BETA1 = 0.9f;
+    constexpr float TUNER_ADAM_BETA2 = 0.999f;
+
+    void write_dataset(const std::string& path, const std::vector<LabeledPosition>& positions)
+    {
+        std::fstream file(path, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+        file.write((char*)DATASET_FILE_HEADER, sizeof(DATASET_FILE_HEADER));
+        file.write((char*)DATASET_FILE_VERSION, sizeof(DATASET_FILE_VERSION));
+        for (const auto& position : positions)
+        {
+            file.write((const char*)&position.Board.Player, sizeof(position.Board.Player));
+            file.write((const char*)&position.Board.Opponent, sizeof(position.Board.Opponent));
+            file.write((const char*)&position.DiscDifferential, sizeof(position.DiscDifferential));
+        }
+        if (!file)
+            throw std::runtime_error("Can't write the dataset file " + path + ".");
+    }
+
+    std::vector<LabeledPosition> read_dataset(const std::string& path)
+    {
+        std::fstream file(path, std::fstream::binary | std::fstream::in);
+        if (!file)
+            throw std::runtime_error("Can't open the dataset file " + path + ".");
+        unsigned char file_check[sizeof(DATASET_FILE_HEADER)];
+        file.read((char*)file_check, sizeof(DATASET_FILE_HEADER));
+        if (!file || !std::equal(file_check, file_check + sizeof(DATASET_FILE_HEADER), DATASET_FILE_HEADER))
+            throw std::runtime_error(path + " is not a dataset file.");
+        file.read((char*)file_check, sizeof(DATASET_FILE_VERSION));
+        if (!file || !std::equal(file_check, file_check + sizeof(DATASET_FILE_VERSION), DATASET_FILE_VERSION))
+            throw std::runtime_error(path + " has an unsupported dataset file version.");
+        std::vector<LabeledPosition> result;
+        LabeledPosition position;
+        while (file.read((char*)&position.Board.Player, sizeof(position.Board.Player))
+            && file.read((char*)&position.Board.Opponent, sizeof(position.Board.Opponent))
+            && file.read((char*)&position.DiscDifferential, sizeof(position.DiscDifferential)))
+            result.push_back(position);
+        return result;
+    }
+
+    /// @brief Plays a game and appends its positions, except the game over one.
+    void generate_game(DecisionTreeAI& ai, std::mt19937& random, std::vector<LabeledPosition>& positions)
+    {
+        Logic state;
+        std::vector<Side> sides;
+        std::size_t first_position = positions.size();
+        while (!state.IsGameOver())
+        {
+            Side side = state.GetCurrentTurn();
+            positions.push_back(LabeledPosition { BitBoard::FromLogic(state, side), 0 });
+            sides.push_back(side);
+            std::tuple<int, int> move;
+            if (std::uniform_real_distribution<float>(0, 1)(random) < TUNER_GENERATION_RANDOM_MOVE_CHANCE)
+            {
+                std::vector<std::tuple<int, int>> moves;
+                for (int x = 0; x < 8; x++)
+                    for (int y = 0; y < 8; y++)
+                        if (state.CanMakeMove(x, y))
+                            moves.push_back(std::make_tuple(x, y));
+                move = moves[std::uniform_int_distribution<int>(0, moves.size() - 1)(random)];
+            }
+            else
+            {
+                move = ai.Decide(state).value();
+            }
+            state.MakeMove(std::get<0>(move), std::get<1>(move));
+        }
+        auto black = BitBoard::FromLogic(state, Side::Black);
+        int black_differential = black.GetPlayerCount() - black.GetOpponentCount();
+        for (std::size_t i = first_position; i < positions.size(); i++)
+            positions[i].DiscDifferential = sides[i - first_position] == Side::Black ? black_differential : -black_differential;
+    }
+
+    void generate(const std::string& dataset_path, int games_count, unsigned int seed)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+        int tasks_count = ThreadPool::GetShared().GetThreadsCount() + 1;
+        std::vector<std::vector<LabeledPosition>> task_positions(tasks_count);
+        TaskGroup tasks(TaskPriority::Background);
+        for (int i = 0; i < tasks_count; i++)
+        {
+            tasks.Run([&, i]()
+                {
+                    DecisionTreeAI ai(TUNER_GENERATION_SEARCH_DEPTH);
+                    std::mt19937 random(seed + i);
+                    for (int game = i; game < games_count; game += tasks_count)
+                        generate_game(ai, random, task_positions[i]);
+                });
+        }
+        tasks.Wait();
+        std::vector<LabeledPosition> positions;
+        for (const auto& part : task_positions)
+            positions.insert(positions.end(), part.begin(), part.end());
+        write_dataset(dataset_path, positions);
+        std::cout << "Wrote " << positions.size() << " positions of " << games_count << " games in "
+            << ((std::chrono::duration<double>)(std::chrono::steady_clock::now() - start_time)).count() << " s.\n";
+    }
+
+    /// @brief The gradients of one task, sparse as each position only touches FEATURES_COUNT weights.
+    struct GradientAccumulator
+    {
+    public:
+        std::vector<float> Gradients;
+        /// @brief The number of positions that touched each weight, 0 if not touched.
+        std::vector<int> Counts;
+        std::vector<int> TouchedIndices;
+        double Loss;
+    };
+
+    /// @return The cross-entropy loss of the prediction, the gradient of the prediction is put in gradient.
+    inline float get_loss(float prediction, int disc_differential, float& gradient)
+    {
+        float target = (disc_differential + 64) / 128.0f;
+        float probability = 1 / (1 + std::exp(-prediction / TUNER_LOGIT_SCALE));
+        gradient = (probability - target) / TUNER_LOGIT_SCALE;
+        constexpr float EPSILON = 1e-7f;
+        return -(target * std::log(probability + EPSILON) + (1 - target) * std::log(1 - probability + EPSILON));
+    }
+
+    void accumulate(const PatternWeights& weights, const LabeledPosition* positions, const int* order, int count,
+        GradientAccumulator& accumulator)
+    {
+        const float* weight_values = weights.GetWeights();
+        int indices[PatternWeights::FEATURES_COUNT];
+        for (int i = 0; i < count; i++)
+        {
+            const auto& position = positions[order[i]];
+            PatternWeights::GetFeatures(position.Board, indices);
+            float prediction = 0;
+            for (int j = 0; j < PatternWeights::FEATURES_COUNT; j++)
+                prediction += weight_values[indices[j]];
+            float gradient;
+            accumulator.Loss += get_loss(prediction, position.DiscDifferential, gradient);
+            for (int j = 0; j < PatternWeights::FEATURES_COUNT; j++)
+            {
+                int index = indices[j];
+                if (accumulator.Counts[index]++ == 0)
+                    accumulator.TouchedIndices.push_back(index);
+                accumulator.Gradients[index] += gradient;
+            }
+        }
+    }
+
+    /// @return The mean absolute error of the predicted disc differentials.
+    double validate(const PatternWeights& weights, const std::vector<LabeledPosition>& positions, const std::vector<int>& order,
+        int start, int end)
+    {
+        double error = 0;
+        for (int i = start; i < end; i++)
+        {
+            const auto& position = positions[order[i]];
+            error += std::abs(weights.Predict(position.Board) - position.DiscDifferential);
+        }
+        return end > start ? error / (end - start) : 0;
+    }
+
+    /// @return The weights in the file, or all weights 0 if it can't be loaded.
+    std::shared_ptr<PatternWeights> load_or_create_weights(const std::string& weights_path)
+    {
+        try
+        {
+            auto weights = PatternWeights::Load(weights_path);
+            std::cout << "Continuing from " << weights_path << ".\n";
+            return weights;
+        }
+        catch (const std::runtime_error&)
+        {
+            return std::make_shared<PatternWeights>();
+        }
+    }
+
+    void tune(const std::string& dataset_path, const std::string& weights_path, int epochs, float learning_rate, int minibatch_size)
+    {
+        auto positions = read_dataset(dataset_path);
+        if (positions.size() == 0)
+            throw std::runtime_error(dataset_path + " has no positions.");
+        auto weights = load_or_create_weights(weights_path);
+
+        std::mt19937 random(0);
+        std::vector<int> order(positions.size());
+        for (int i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), random);
+        int training_count = order.size() - (int)(order.size() * TUNER_VALIDATION_FRACTION);
+        std::cout << training_count << " training and " << order.size() - training_count << " validation positions.\n";
+
+        int tasks_count = ThreadPool::GetShared().GetThreadsCount() + 1;
+        std::vector<GradientAccumulator> accumulators(tasks_count);
+        for (auto& accumulator : accumulators)
+        {
+            accumulator.Gradients.assign(weights->GetWeightsCount(), 0);
+            accumulator.Counts.assign(weights->GetWeightsCount(), 0);
+        }
+        float* weight_values = weights->GetWeights();
+        for (int epoch = 1; epoch <= epochs; epoch++)
+        {
+            auto start_time = std::chrono::steady_clock::now();
+            std::shuffle(order.begin(), order.begin() + training_count, random);
+            double loss = 0;
+            for (int batch_start = 0; batch_start < training_count; batch_start += minibatch_size)
+            {
+                int batch_count = std::min(minibatch_size, training_count - batch_start);
+                int chunk_size = (batch_count + tasks_count - 1) / tasks_count;
+                TaskGroup tasks;
+                for (int i = 0; i < tasks_count; i++)
+                {
+                    int chunk_start = std::min(batch_count, i * chunk_size);
+                    int chunk_count = std::min(batch_count - chunk_start, chunk_size);
+                    tasks.Run([&, i, chunk_start, chunk_count]()
+                        {
+                            accumulate(*weights, positions.data(), order.data() + batch_start + chunk_start, chunk_count, accumulators[i]);
+                        });
+                }
+                tasks.Wait();
+                // The weights are updated after the whole minibatch, so the tasks only read them.
+                // The gradients of a weight are averaged over the positions that touched it,
+                // otherwise the common configurations, like empty lines, would take steps too large.
+                auto& total = accumulators[0];
+                for (int i = 1; i < tasks_count; i++)
+                {
+                    auto& accumulator = accumulators[i];
+                    for (int index : accumulator.TouchedIndices)
+                    {
+                        if (total.Counts[index] == 0)
+                            total.TouchedIndices.push_back(index);
+                        total.Gradients[index] += accumulator.Gradients[index];
+                        total.Counts[index] += accumulator.Counts[index];
+                        accumulator.Gradients[index] = 0;
+                        accumulator.Counts[index] = 0;
+                    }
+                    accumulator.TouchedIndices.clear();
+                    total.Loss += accumulator.Loss;
+                    accumulator.Loss = 0;
+                }
+                for (int index : total.TouchedIndices)
+                {
+                    weight_values[index] -= learning_rate * total.Gradients[index] / total.Counts[index];
+                    total.Gradients[index] = 0;
+                    total.Counts[index] = 0;
+                }
+                total.TouchedIndices.clear();
+                loss += total.Loss;
+                total.Loss = 0;
+            }
+            std::cout << "Epoch " << epoch << ": loss " << loss / training_count
+                << ", validation mean absolute error " << validate(*weights, positions, order, training_count, order.size()) << " discs, "
+                << ((std::chrono::duration<double>)(std::chrono::steady_clock::now() - start_time)).count() << " s\n";
+        }
+        weights->Save(weights_path);
+        std::cout << "Saved " << weights_path << ".\n";
+    }
+
+    /// @brief Maps the board by one of its 8 symmetries.
+    /// @param symmetry Bit 0 mirrors x, bit 1 mirrors y, bit 2 swaps x and y.
+    BitBoard transform_board(const BitBoard& board, int symmetry)
+    {
+        BitBoard result { 0, 0 };
+        for (int index = 0; index < 64; index++)
+        {
+            int x = index & 7;
+            int y = index >> 3;
+            if (symmetry & 1)
+                x = 7 - x;
+            if (symmetry & 2)
+                y = 7 - y;
+            if (symmetry & 4)
+                std::swap(x, y);
+            result.Player |= ((board.Player >> index) & 1) << (y << 3 | x);
+            result.Opponent |= ((board.Opponent >> index) & 1) << (y << 3 | x);
+        }
+        return result;
+    }
+
+    /// @return The prediction of the float network in discs.
+    float predict_network(const float* parameters, const BitBoard& board)
+    {
+        constexpr int FIRST_SIZE = NetworkWeights::FIRST_LAYER_SIZE;
+        constexpr int SECOND_SIZE = NetworkWeights::SECOND_LAYER_SIZE;
+        float first[FIRST_SIZE];
+        for (int j = 0; j < FIRST_SIZE; j++)
+            first[j] = parameters[TUNER_NETWORK_FIRST_BIASES + j];
+        for (int input = 0; input < NetworkWeights::INPUTS_COUNT; input++)
+            if (((input < 64 ? board.Player : board.Opponent) >> (input & 63)) & 1)
+                for (int j = 0; j < FIRST_SIZE; j++)
+                    first[j] += parameters[TUNER_NETWORK_FIRST_WEIGHTS + input * FIRST_SIZE + j];
+        float output = parameters[TUNER_NETWORK_OUTPUT_BIAS];
+        for (int i = 0; i < SECOND_SIZE; i++)
+        {
+            float second = parameters[TUNER_NETWORK_SECOND_BIASES + i];
+            for (int j = 0; j < FIRST_SIZE; j++)
+                second += parameters[TUNER_NETWORK_SECOND_WEIGHTS + i * FIRST_SIZE + j] * std::clamp(first[j], 0.0f, 1.0f);
+            output += parameters[TUNER_NETWORK_OUTPUT_WEIGHTS + i] * std::clamp(second, 0.0f, 1.0f);
+        }
+        return output;
+    }
+
+    /// @brief Adds the gradients of the loss of the positions, each in a random symmetry, to gradients.
+    /// @return The total loss.
+    double accumulate_network(const float* parameters, const LabeledPosition* positions, const int* order, int count,
+        std::mt19937& random, float* gradients)
+    {
+        constexpr int FIRST_SIZE = NetworkWeights::FIRST_LAYER_SIZE;
+        constexpr int SECOND_SIZE = NetworkWeights::SECOND_LAYER_SIZE;
+        double loss = 0;
+        int inputs[64];
+        float first[FIRST_SIZE];
+        float first_gradients[FIRST_SIZE];
+        float second[SECOND_SIZE];
+        for (int position_index = 0; position_index < count; position_index++)
+        {
+            const auto& position = positions[order[position_index]];
+            BitBoard board = transform_board(position.Board, std::uniform_int_distribution<int>(0, 7)(random));
+            int inputs_count = 0;
+            for (unsigned long long discs = board.Player; discs; discs &= discs - 1)
+                inputs[inputs_count++] = std::countr_zero(discs);
+            for (unsigned long long discs = board.Opponent; discs; discs &= discs - 1)
+                inputs[inputs_count++] = 64 + std::countr_zero(discs);
+
+            for (int j = 0; j < FIRST_SIZE; j++)
+                first[j] = parameters[TUNER_NETWORK_FIRST_BIASES + j];
+            for (int k = 0; k < inputs_count; k++)
+                for (int j = 0; j < FIRST_SIZE; j++)
+                    first[j] += parameters[TUNER_NETWORK_FIRST_WEIGHTS + inputs[k] * FIRST_SIZE + j];
+            float output = parameters[TUNER_NETWORK_OUTPUT_BIAS];
+            for (int i = 0; i < SECOND_SIZE; i++)
+            {
+                second[i] = parameters[TUNER_NETWORK_SECOND_BIASES + i];
+                for (int j = 0; j < FIRST_SIZE; j++)
+                    second[i] += parameters[TUNER_NETWORK_SECOND_WEIGHTS + i * FIRST_SIZE + j] * std::clamp(first[j], 0.0f, 1.0f);
+                output += parameters[TUNER_NETWORK_OUTPUT_WEIGHTS + i] * std::clamp(second[i], 0.0f, 1.0f);
+            }
+
+            float gradient;
+            loss += get_loss(output, position.DiscDifferential, gradient);
+            gradients[TUNER_NETWORK_OUTPUT_BIAS] += gradient;
+            for (int j = 0; j < FIRST_SIZE; j++)
+                first_gradients[j] = 0;
+            for (int i = 0; i < SECOND_SIZE; i++)
+            {
+                gradients[TUNER_NETWORK_OUTPUT_WEIGHTS + i] += gradient * std::clamp(second[i], 0.0f, 1.0f);
+                // The clamped activations pass no gradient
+                if (second[i] <= 0 || second[i] >= 1)
+                    continue;
+                float second_gradient = gradient * parameters[TUNER_NETWORK_OUTPUT_WEIGHTS + i];
+                gradients[TUNER_NETWORK_SECOND_BIASES + i] += second_gradient;
+                for (int j = 0; j < FIRST_SIZE; j++)
+                {
+                    gradients[TUNER_NETWORK_SECOND_WEIGHTS + i * FIRST_SIZE + j] += second_gradient * std::clamp(first[j], 0.0f, 1.0f);
+                    first_gradients[j] += second_gradient * parameters[TUNER_NETWORK_SECOND_WEIGHTS + i * FIRST_SIZE + j];
+                }
+            }
+            for (int j = 0; j < FIRST_SIZE; j++)
+                if (first[j] <= 0 || first[j] >= 1)
+                    first_gradients[j] = 0;
+            for (int j = 0; j < FIRST_SIZE; j++)
+                gradients[TUNER_NETWORK_FIRST_BIASES + j] += first_gradients[j];
+            for (int k = 0; k < inputs_count; k++)
+                for (int j = 0; j < FIRST_SIZE; j++)
+                    gradients[TUNER_NETWORK_FIRST_WEIGHTS + inputs[k] * FIRST_SIZE + j] += first_gradients[j];
+        }
+        return loss;
+    }
+
+    NetworkParameters to_network_parameters(const std::vector<float>& parameters)
+    {
+        auto begin = parameters.begin();
+        return NetworkParameters {
+            std::vector<float>(begin + TUNER_NETWORK_FIRST_WEIGHTS, begin + TUNER_NETWORK_FIRST_BIASES),
+            std::vector<float>(begin + TUNER_NETWORK_FIRST_BIASES, begin + TUNER_NETWORK_SECOND_WEIGHTS),
+            std::vector<float>(begin + TUNER_NETWORK_SECOND_WEIGHTS, begin + TUNER_NETWORK_SECOND_BIASES),
+            std::vector<float>(begin + TUNER_NETWORK_SECOND_BIASES, begin + TUNER_NETWORK_OUTPUT_WEIGHTS),
+            std::vector<float>(begin + TUNER_NETWORK_OUTPUT_WEIGHTS, begin + TUNER_NETWORK_OUTPUT_BIAS),
+            parameters[TUNER_NETWORK_OUTPUT_BIAS]
+        };
+    }
+
+    void train_network(const std::string& dataset_path, const std::string& network_path, int epochs, float learning_rate, int minibatch_size)
+    {
+        auto positions = read_dataset(dataset_path);
+        if (positions.size() == 0)
+            throw std::runtime_error(dataset_path + " has no positions.");
+        std::mt19937 random(0);
+        std::vector<int> order(positions.size());
+        for (int i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), random);
+        int training_count = order.size() - (int)(order.size() * TUNER_VALIDATION_FRACTION);
+        std::cout << training_count << " training and " << order.size() - training_count << " validation positions.\n";
+
+        // The first layer starts in the middle of the clamping range, so that all activations learn
+        std::vector<float> parameters(TUNER_NETWORK_PARAMETERS_COUNT, 0);
+        std::uniform_real_distribution<float> first_distribution(-0.1f, 0.1f);
+        std::uniform_real_distribution<float> second_distribution(-0.25f, 0.25f);
+        std::uniform_real_distribution<float> output_distribution(-1, 1);
+        for (int i = TUNER_NETWORK_FIRST_WEIGHTS; i < TUNER_NETWORK_FIRST_BIASES; i++)
+            parameters[i] = first_distribution(random);
+        for (int i = TUNER_NETWORK_FIRST_BIASES; i < TUNER_NETWORK_SECOND_WEIGHTS; i++)
+            parameters[i] = 0.5f;
+        for (int i = TUNER_NETWORK_SECOND_WEIGHTS; i < TUNER_NETWORK_SECOND_BIASES; i++)
+            parameters[i] = second_distribution(random);
+        for (int i = TUNER_NETWORK_SECOND_BIASES; i < TUNER_NETWORK_OUTPUT_WEIGHTS; i++)
+            parameters[i] = 0.5f;
+        for (int i = TUNER_NETWORK_OUTPUT_WEIGHTS; i < TUNER_NETWORK_OUTPUT_BIAS; i++)
+            parameters[i] = output_distribution(random);
+
+        int tasks_count = ThreadPool::GetShared().GetThreadsCount() + 1;
+        std::vector<std::vector<float>> task_gradients(tasks_count, std::vector<float>(TUNER_NETWORK_PARAMETERS_COUNT, 0));
+        std::vector<double> task_losses(tasks_count);
+        std::vector<std::mt19937> task_randoms;
+        for (int i = 0; i < tasks_count; i++)
+            task_randoms.emplace_back(i);
+        std::vector<float> first_moments(TUNER_NETWORK_PARAMETERS_COUNT, 0);
+        std::vector<float> second_moments(TUNER_NETWORK_PARAMETERS_COUNT, 0);
+        int steps = 0;
+        for (int epoch = 1; epoch <= epochs; epoch++)
+        {
+            auto start_time = std::chrono::steady_clock::now();
+            std::shuffle(order.begin(), order.begin() + training_count, random);
+            double loss = 0;
+            for (int batch_start = 0; batch_start < training_count; batch_start += minibatch_size)
+            {
+                int batch_count = std::min(minibatch_size, training_count - batch_start);
+                int chunk_size = (batch_count + tasks_count - 1) / tasks_count;
+                TaskGroup tasks;
+                for (int i = 0; i < tasks_count; i++)
+                {
+                    int chunk_start = std::min(batch_count, i * chunk_size);
+                    int chunk_count = std::min(batch_count - chunk_start, chunk_size);
+                    tasks.Run([&, i, chunk_start, chunk_count]()
+                        {
+                            task_losses[i] = accumulate_network(parameters.data(), positions.data(), order.data() + batch_start + chunk_start,
+                                chunk_count, task_randoms[i], task_gradients[i].data());
+                        });
+                }
+                tasks.Wait();
+                // Adam on the mean gradient of the minibatch, then the weights are kept in the quantizable ranges
+                steps++;
+                float first_correction = 1 - std::pow(TUNER_ADAM_BETA1, (float)steps);
+                float second_correction = 1 - std::pow(TUNER_ADAM_BETA2, (float)steps);
+                for (int index = 0; index < TUNER_NETWORK_PARAMETERS_COUNT; index++)
+                {
+                    float gradient = 0;
+                    for (auto& gradients : task_gradients)
+                    {
+                        gradient += gradients[index];
+                        gradients[index] = 0;
+                    }
+                    gradient /= batch_count;
+                    first_moments[index] = TUNER_ADAM_BETA1 * first_moments[index] + (1 - TUNER_ADAM_BETA1) * gradient;
+                    second_moments[index] = TUNER_ADAM_BETA2 * second_moments[index] + (1 - TUNER_ADAM_BETA2) * gradient * gradient;
+                    parameters[index] -= learning_rate * (first_moments[index] / first_correction)
+                        / (std::sqrt(second_moments[index] / second_correction) + 1e-8f);
+                }
+                for (int i = TUNER_NETWORK_FIRST_WEIGHTS; i < TUNER_NETWORK_SECOND_WEIGHTS; i++)
+                    parameters[i] = std::clamp(parameters[i], -NetworkWeights::MAX_FIRST_WEIGHT, NetworkWeights::MAX_FIRST_WEIGHT);
+                for (int i = TUNER_NETWORK_SECOND_WEIGHTS; i < TUNER_NETWORK_SECOND_BIASES; i++)
+                    parameters[i] = std::clamp(parameters[i], -NetworkWeights::MAX_SECOND_WEIGHT, NetworkWeights::MAX_SECOND_WEIGHT);
+                for (double task_loss : task_losses)
+                    loss += task_loss;
+            }
+
+            auto network = NetworkWeights::Quantize(to_network_parameters(parameters));
+            double error = 0;
+            double quantized_error = 0;
+            for (int i = training_count; i < order.size(); i++)
+            {
+                const auto& position = positions[order[i]];
+                error += std::abs(predict_network(parameters.data(), position.Board) - position.DiscDifferential);
+                quantized_error += std::abs(network->Predict(position.Board) - position.DiscDifferential);
+            }
+            int validation_count = std::max(1, (int)order.size() - training_count);
+            std::cout << "Epoch " << epoch << ": loss " << loss / training_count
+                << ", validation mean absolute error " << error / validation_count << " discs, "
+                << quantized_error / validation_count << " discs quantized, "
+                << ((std::chrono::duration<double>)(std::chrono::steady_clock::now() - start_time)).count() << " s\n";
+        }
+        NetworkWeights::Quantize(to_network_parameters(parameters))->Save(network_path);
+        std::cout << "Saved " << network_path << ".\n";
+    }
+
+    void self_play(const std::string& weights_path, int games_count, float learning_rate, float lambda, float exploration,
+        unsigned int seed)
+    {
+        auto weights = load_or_create_weights(weights_path);
+        TDLearner learner(weights, learning_rate, lambda);
+        std::mt19937 random(seed);
+        auto start_time = std::chrono::steady_clock::now();
+        long long positions_count = 0;
+        int report_interval = std::max(1, games_count / 10);
+        for (int game = 1; game <= games_count; game++)
+        {
+            positions_count += learner.PlaySelfPlayGame(random, exploration);
+            if (game % report_interval == 0 || game == games_count)
+            {
+                double seconds = ((std::chrono::duration<double>)(std::chrono::steady_clock::now() - start_time)).count();
+                std::cout << game << " games, " << positions_count << " positions, "
+                    << (long long)(positions_count / seconds * 3600) << " positions per hour\n";
+            }
+        }
+        weights->Save(weights_path);
+        std::cout << "Saved " << weights_path << ".\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    try
+    {
+        int threads_count = 0;
+        bool pin_threads = false;
+        while (args.size() > 0 && (args[0] == "--threads" || args[0] == "--pin"))
+        {
+            if (args[0] == "--pin")
+            {
+                pin_threads = true;
+                args.erase(args.begin());
+            }
+            else if (args.size() >= 2 && std::stoi(args[1]) > 0)
+            {
+                threads_count = std::stoi(args[1]);
+                args.erase(args.begin(), args.begin() + 2);
+            }
+            else
+            {
+                break; // Printing the usage
+            }
+        }
+        Reversi::ThreadPool::ConfigureShared(threads_count, pin_threads);
+        if (args.size() >= 3 && args[0] == "generate")
+        {
+            Reversi::generate(args[1], std::stoi(args[2]), args.size() > 3 ? std::stoul(args[3]) : 0);
+            return 0;
+        }
+        if (args.size() >= 3 && args[0] == "tune")
+        {
+            int minibatch_size = args.size() > 5 ? std::stoi(args[5]) : 1024;
+            if (minibatch_size > 0)
+            {
+                Reversi::tune(args[1], args[2],
+                    args.size() > 3 ? std::stoi(args[3]) : 10,
+                    args.size() > 4 ? std::stof(args[4]) : 16,
+                    minibatch_size);
+                return 0;
+            }
+        }
+        if (args.size() >= 3 && args[0] == "trainnet")
+        {
+            int minibatch_size = args.size() > 5 ? std::stoi(args[5]) : 256;
+            if (minibatch_size > 0)
+            {
+                Reversi::train_network(args[1], args[2],
+                    args.size() > 3 ? std::stoi(args[3]) : 10,
+                    args.size() > 4 ? std::stof(args[4]) : 0.001f,
+                    minibatch_size);
+                return 0;
+            }
+        }
+        if (args.size() >= 3 && args[0] == "selfplay")
+        {
+            Reversi::self_play(args[1], std::stoi(args[2]),
+                args.size() > 3 ? std::stof(args[3]) : 64,
+                args.size() > 4 ? std::stof(args[4]) : 0.7f,
+                args.size() > 5 ? std::stof(args[5]) : 0.1f,
+                args.size() > 6 ? std::stoul(args[6]) : 0);
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::cout << "Usage:\n";
+    std::cout << "ReversiTuner [--threads <count>] [--pin] <command> ...\n";
+    std::cout << "ReversiTuner generate <dataset file> <games count> [seed]\n";
+    std::cout << "ReversiTuner tune <dataset file> <weights file> [epochs = 10] [learning rate = 16] [minibatch size = 1024]\n";
+    std::cout << "ReversiTuner trainnet <dataset file> <network file> [epochs = 10] [learning rate = 0.001] [minibatch size = 256]\n";
+    std::cout << "ReversiTuner selfplay <weights file> <games count> [learning rate = 64] [lambda = 0.7] [exploration = 0.1] [seed]\n";
+    return 1;
+}